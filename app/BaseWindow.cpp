@@ -19,6 +19,7 @@
 
 #include <mqueue.h>
 
+#include "../common/FmqMonitor.h"
 #include "../common/FrameTimeInfo.h"
 #include "../common/WindowUtils.h"
 #include "SurfaceTransaction.h"
@@ -47,9 +48,12 @@ Status BaseWindow::W::dispatchAppVisibility(bool visible) {
     return Status::ok();
 }
 
-Status BaseWindow::W::onFrame(int32_t seq) {
+Status BaseWindow::W::onFrame(int32_t seq, int64_t vsyncTime, int64_t deadline,
+                              int64_t presentTime) {
     if (mBaseWindow != nullptr) {
-        mBaseWindow->onFrame(seq);
+        VsyncEvent event = {(uint32_t)seq, 0, (uint64_t)vsyncTime, (uint64_t)deadline,
+                            (uint64_t)presentTime};
+        mBaseWindow->onFrame(event);
     }
     return Status::ok();
 }
@@ -78,7 +82,11 @@ BaseWindow::BaseWindow(::os::app::Context* context, WindowManager* wm)
         mFrameDone(true),
         mSurfaceBufferReady(false),
         mTraceFrame(false),
-        mFrameTimeInfo(nullptr) {
+        mFrameTimeInfo(nullptr),
+        mPendingReleaseSkips(0),
+        mFrameSuppressed(false),
+        mSuppressedSeq(0),
+        mVsyncRateDivisor(1) {
     if (mWindowManager == nullptr) {
         FLOGE("%p no valid window manager", this);
         return;
@@ -110,6 +118,9 @@ bool BaseWindow::scheduleVsync(VsyncRequest freq) {
     auto newfreq = (mUIProxy.get() && mUIProxy->vsyncEventEnabled())
             ? VsyncRequest::VSYNC_REQ_PERIODIC
             : freq;
+    if (newfreq == VsyncRequest::VSYNC_REQ_PERIODIC) {
+        newfreq = periodicVsyncRequest(mVsyncRateDivisor);
+    }
     if (mVsyncRequest == newfreq) {
         return false;
     }
@@ -117,8 +128,7 @@ bool BaseWindow::scheduleVsync(VsyncRequest freq) {
     WM_PROFILER_BEGIN();
 
     if (mUIProxy->frameMetaInfo() && mFrameTimeInfo &&
-        (newfreq == VsyncRequest::VSYNC_REQ_PERIODIC ||
-         mVsyncRequest == VsyncRequest::VSYNC_REQ_PERIODIC)) {
+        (isPeriodicVsync(newfreq) || isPeriodicVsync(mVsyncRequest))) {
         static_cast<FrameTimeInfo*>(mFrameTimeInfo)->time(NULL);
     }
 
@@ -130,6 +140,15 @@ bool BaseWindow::scheduleVsync(VsyncRequest freq) {
     return true;
 }
 
+void BaseWindow::setVsyncRateDivisor(uint32_t divisor) {
+    mVsyncRateDivisor = divisor > 0 ? divisor : 1;
+
+    /* update a running periodic request to the new rate */
+    if (isPeriodicVsync(mVsyncRequest)) {
+        scheduleVsync(VsyncRequest::VSYNC_REQ_PERIODIC);
+    }
+}
+
 void* BaseWindow::getNativeDisplay() {
     return mUIProxy.get() != nullptr ? mUIProxy->getRoot() : nullptr;
 }
@@ -181,16 +200,32 @@ void BaseWindow::setInputChannel(InputChannel* inputChannel) {
 }
 
 void BaseWindow::clearSurfaceBuffer() {
+    if (mReleaseMonitor) mReleaseMonitor->stop();
+    if (mVsyncMonitor) mVsyncMonitor->stop();
+    mFrameSuppressed = false;
+
 #ifdef CONFIG_ENABLE_BUFFER_QUEUE_BY_NAME
     /*destroy current sc buffers */
     if (mSurfaceBufferReady) {
-        uninitSurfaceBuffer(mSurfaceControl);
+        uninitSurfaceBuffer(mSurfaceControl, false);
         mSurfaceBufferReady = false;
     }
 #endif
 }
 
 void BaseWindow::setSurfaceControl(SurfaceControl* surfaceControl) {
+    /* service kept the surface, buffers and their states are still valid */
+    if (surfaceControl != nullptr && mSurfaceControl.get() != nullptr &&
+        surfaceControl->isValid() && mSurfaceControl->isValid() &&
+        surfaceControl->getHandle() == mSurfaceControl->getHandle()) {
+        FLOGI("%p surface is unchanged", this);
+        for (const auto& id : surfaceControl->bufferIds()) {
+            if (id.mFd > 0) close(id.mFd);
+        }
+        delete surfaceControl;
+        return;
+    }
+
     /*reset current buffer when surface changed*/
     mUIProxy->resetBuffer();
 
@@ -206,13 +241,33 @@ void BaseWindow::setSurfaceControl(SurfaceControl* surfaceControl) {
 #ifdef CONFIG_ENABLE_BUFFER_QUEUE_BY_NAME
         initSurfaceBuffer(mSurfaceControl, false);
         mSurfaceBufferReady = true;
+#elif defined(CONFIG_ENABLE_SHARED_BUFFER_STATE)
+        mSurfaceControl->initBufferState(false);
 #endif
+
+        /* wake up as soon as service releases a buffer we are waiting for */
+        int eventFd = mSurfaceControl->getFMQ().getEventFd();
+        if (eventFd >= 0) {
+            if (!mReleaseMonitor) mReleaseMonitor = std::make_shared<FmqMonitor>();
+            mReleaseMonitor->start(mContext->getMainLoop()->get(), eventFd,
+                                   [this]() { onBuffersReleased(); });
+        }
+
+        /* frames come from the vsync channel while the surface lives */
+        auto& vsyncFmq = mSurfaceControl->getVsyncFMQ();
+        if (vsyncFmq.getEventFd() >= 0) {
+            if (!mVsyncMonitor) mVsyncMonitor = std::make_shared<FmqMonitor>();
+            vsyncFmq.armNotify();
+            mVsyncMonitor->start(mContext->getMainLoop()->get(), vsyncFmq.getEventFd(),
+                                 [this]() { onVsyncEvents(); });
+        }
     }
 }
 
-void BaseWindow::onFrame(int32_t seq) {
+void BaseWindow::onFrame(const VsyncEvent& event) {
     WM_PROFILER_BEGIN();
 
+    uint32_t seq = event.mSeq;
     mVsyncRequest = nextVsyncState(mVsyncRequest);
     FLOGD("%p frame seq=%" PRIu32 "", this, seq);
 
@@ -221,11 +276,24 @@ void BaseWindow::onFrame(int32_t seq) {
         return;
     }
 
-    /* mark vsync */
+    /* mark vsync with the server time, so the ipc delay is part of the frame */
     auto info = mUIProxy->frameMetaInfo();
-    if (info) info->setVsync(FrameMetaInfo::getCurSysTime(), seq, mUIProxy->getTimerPeriod());
+    if (info) {
+        uint32_t period = event.mPeriod > 0 ? event.mPeriod : mUIProxy->getTimerPeriod();
+        info->setVsync(event.mTimestamp / 1000, seq, period);
+        info->setFrameTimeline(event.mDeadline / 1000, event.mPresentTime / 1000);
+    }
     mUIProxy->notifyVsyncEvent();
 
+    /* a later vsync is coming, don't render a frame that can't be latched in time */
+    if (isPeriodicVsync(mVsyncRequest) && event.mDeadline > 0 &&
+        curSysTimeUs() > event.mDeadline) {
+        FLOGD("%p frame seq=%" PRIu32 ", missed deadline!", this, seq);
+        if (info) info->setSkipReason(FrameMetaSkipReason::MissedDeadline);
+        WM_PROFILER_END();
+        return;
+    }
+
     if (!mFrameDone.load(std::memory_order_acquire)) {
         FLOGD("%p frame seq=%" PRIu32 ", waiting frame done!", this, seq);
         if (info) info->setSkipReason(FrameMetaSkipReason::NoTarget);
@@ -251,10 +319,11 @@ void BaseWindow::onFrame(int32_t seq) {
             FLOGI("SingleFrameLog{seq=%" PRIu32 ", skip=%d}", seq, (int)(*skipReason));
         } else {
             FLOGW("SingleFrameLog{seq=%" PRIu32 ", totalMs=%" PRId64 ", animMs=%" PRId64
-                  ", renderMs=%" PRId64 ", layoutMs=%" PRId64 ", transactMs=%" PRId64 "}",
+                  ", renderMs=%" PRId64 ", layoutMs=%" PRId64 ", transactMs=%" PRId64
+                  ", overrunMs=%" PRId64 "}",
                   seq, info->totalDuration(), info->totalVsyncDuration(),
                   info->totalRenderDuration(), info->totalLayoutDuration(),
-                  info->totalTransactDuration());
+                  info->totalTransactDuration(), info->deadlineOverrun());
         }
         if (mFrameTimeInfo) static_cast<FrameTimeInfo*>(mFrameTimeInfo)->time(info);
     }
@@ -304,6 +373,7 @@ void BaseWindow::handleOnFrame(int32_t seq) {
             updateOrCreateBufferQueue();
         }
     } else {
+        mFrameSuppressed = false;
         std::shared_ptr<BufferProducer> buffProducer = getBufferProducer();
         if (buffProducer.get() == nullptr) {
             FLOGI("%p seq=%" PRIu32 " buffProducer is invalid!", this, seq);
@@ -311,14 +381,21 @@ void BaseWindow::handleOnFrame(int32_t seq) {
             return;
         }
 
-        BufferKey key;
-        if (mSurfaceControl->getFMQ().read(&(key))) {
-            bufferReleased(key);
-        }
+        drainReleasedBuffers();
 
         BufferItem* item = buffProducer->dequeueBuffer();
         if (!item) {
-            if (mVsyncRequest != VsyncRequest::VSYNC_REQ_PERIODIC)
+            auto& fmq = mSurfaceControl->getFMQ();
+            /* the server had a buffer back for us, it just landed after we looked */
+            if (buffProducer->pendingReleases() > 0) mPendingReleaseSkips++;
+
+            /* retry from onBuffersReleased, a release may land before arming */
+            mFrameSuppressed = true;
+            mSuppressedSeq = seq;
+            fmq.armNotify();
+            if (fmq.size() > 0) fmq.notify();
+
+            if (!isPeriodicVsync(mVsyncRequest))
                 scheduleVsync(VsyncRequest::VSYNC_REQ_SINGLESUPPRESS);
             FLOGI("%p seq=%" PRIu32 " no valid buffer!\n", this, seq);
             if (info) info->setSkipReason(FrameMetaSkipReason::NoBuffer);
@@ -335,12 +412,14 @@ void BaseWindow::handleOnFrame(int32_t seq) {
             return;
         }
         if (info) info->markSyncQueued();
-        buffProducer->queueBuffer(item);
+        auto rect = mUIProxy->rectCrop();
+        buffProducer->queueBuffer(item, rect);
 
         auto transaction = mWindowManager->getTransaction();
         transaction->setBuffer(mSurfaceControl, *item, seq);
-        auto rect = mUIProxy->rectCrop();
-        if (rect) transaction->setBufferCrop(mSurfaceControl, *rect);
+        uint32_t damageCount = 0;
+        auto damage = mUIProxy->damageRects(&damageCount);
+        if (damage) transaction->setBufferDamage(mSurfaceControl, damage, damageCount);
 
         FLOGI("%p seq=%" PRIu32 " apply frame transaction\n", this, seq);
         transaction->apply();
@@ -367,6 +446,55 @@ void BaseWindow::bufferReleased(int32_t bufKey) {
     FLOGI("%p release bufKey:%" PRId32 " done!\n", this, bufKey);
 }
 
+void BaseWindow::drainReleasedBuffers() {
+    BufferKey keys[BUFFER_QUEUE_MAX_SLOTS];
+    uint32_t count;
+
+    do {
+        count = mSurfaceControl->getFMQ().readAll(keys, BUFFER_QUEUE_MAX_SLOTS);
+        for (uint32_t i = 0; i < count; i++) {
+            bufferReleased(keys[i]);
+        }
+    } while (count == BUFFER_QUEUE_MAX_SLOTS);
+}
+
+void BaseWindow::onBuffersReleased() {
+    if (mSurfaceControl.get() == nullptr) return;
+
+    mSurfaceControl->getFMQ().clearNotify();
+    if (!mFrameSuppressed || !mFrameDone.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    FLOGD("%p retry frame seq=%" PRIu32 " on buffer release", this, mSuppressedSeq);
+    mFrameSuppressed = false;
+    mFrameDone.exchange(false, std::memory_order_release);
+    handleOnFrame(mSuppressedSeq);
+    mFrameDone.exchange(true, std::memory_order_release);
+}
+
+void BaseWindow::onVsyncEvents() {
+    if (mSurfaceControl.get() == nullptr) return;
+
+    auto& fmq = mSurfaceControl->getVsyncFMQ();
+    fmq.clearNotify();
+
+    /* only the latest vsync matters when several piled up */
+    VsyncEvent events[SURFACE_VSYNC_CAPS];
+    VsyncEvent latest;
+    bool received = false;
+    do {
+        uint32_t count;
+        while ((count = fmq.readAll(events, SURFACE_VSYNC_CAPS)) > 0) {
+            latest = events[count - 1];
+            received = true;
+        }
+        fmq.armNotify();
+    } while (fmq.size() > 0);
+
+    if (received) onFrame(latest);
+}
+
 void BaseWindow::updateOrCreateBufferQueue() {
     if (mSurfaceControl->bufferQueue() != nullptr) {
         mSurfaceControl->bufferQueue()->update(mSurfaceControl);
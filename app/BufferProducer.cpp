@@ -25,6 +25,9 @@ BufferProducer::BufferProducer(const std::shared_ptr<SurfaceControl>& sc) : Buff
 BufferProducer::~BufferProducer() {}
 
 BufferItem* BufferProducer::dequeueBuffer() {
+    // pick up the buffers released through shared state
+    syncSharedState();
+
     BufferItem* bufferItem = getBuffer(BSLOT_FREE);
     if (bufferItem != nullptr && toState(bufferItem, BSTATE_DEQUEUED)) {
         return bufferItem;
@@ -32,11 +35,21 @@ BufferItem* BufferProducer::dequeueBuffer() {
     return nullptr;
 }
 
-bool BufferProducer::queueBuffer(BufferItem* buffer) {
-    if (buffer == nullptr) {
+uint32_t BufferProducer::pendingReleases() {
+    // released in shared state after the last sync, or released messages not drained yet
+    uint32_t count = sharedReleasedCount();
+    auto sc = getSurfaceControl();
+    if (sc) count += sc->getFMQ().size();
+    return count;
+}
+
+bool BufferProducer::queueBuffer(BufferItem* buffer, const Rect* damage) {
+    if (buffer == nullptr || !toState(buffer, BSTATE_QUEUED)) {
         return false;
     }
-    return toState(buffer, BSTATE_QUEUED);
+
+    updateBufferAge(buffer, damage);
+    return true;
 }
 
 } // namespace wm
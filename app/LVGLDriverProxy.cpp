@@ -18,6 +18,8 @@
 
 #include "LVGLDriverProxy.h"
 
+#include <algorithm>
+
 #include <lvgl/lvgl.h>
 #include <lvgl/src/lvgl_private.h>
 
@@ -109,8 +111,18 @@ void LVGLDriverProxy::onRenderStart() {
 
     mDisp->buf_act = (lv_draw_buf_t*)buffer;
 
-    if (mRenderMode == LV_DISPLAY_RENDER_MODE_DIRECT && mPrevBuffer && !mAllAreaDirty) {
+    BufferItem* item = getBufferItem();
+    if (mRenderMode == LV_DISPLAY_RENDER_MODE_DIRECT && mPrevBuffer && !mAllAreaDirty &&
+        mPrevBuffer != item && item->mAge != 1) {
         lv_area_t area = {0, 0, mDispW - 1, mDispH - 1};
+
+        /* only bring back what changed since this buffer was displayed */
+        if (item->mAge > 1) {
+            lv_area_t damage = {item->mDamage.left, item->mDamage.top, item->mDamage.right,
+                                item->mDamage.bottom};
+            if (!_lv_area_intersect(&area, &area, &damage)) return;
+        }
+
         WM_PROFILER_BEGIN();
         lv_draw_buf_copy((lv_draw_buf_t*)buffer, &area, (lv_draw_buf_t*)(mPrevBuffer->mUserData),
                          &area);
@@ -123,11 +135,51 @@ void LVGLDriverProxy::onRenderEnd() {
     if (mRenderMode == LV_DISPLAY_RENDER_MODE_DIRECT) {
         mPrevBuffer = getBufferItem();
 
-        lv_area_t area;
-        lv_display_get_dirty_area(mDisp, &area);
-        Rect inv_rect = Rect(area.x1, area.y1, area.x2, area.y2);
-        onRectCrop(inv_rect);
+        Rect rects[LAYER_STATE_MAX_DAMAGE];
+        uint32_t count = mAllAreaDirty ? 0 : collectDamage(rects);
+        if (count > 0) {
+            onDamageRects(rects, count);
+        } else {
+            lv_area_t area;
+            lv_display_get_dirty_area(mDisp, &area);
+            Rect inv_rect = Rect(area.x1, area.y1, area.x2, area.y2);
+            onRectCrop(inv_rect);
+        }
+    }
+}
+
+uint32_t LVGLDriverProxy::collectDamage(Rect* rects) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < mDisp->inv_p; i++) {
+        if (mDisp->inv_area_joined[i]) continue;
+
+        const lv_area_t* area = &mDisp->inv_areas[i];
+        Rect rect = Rect(area->x1, area->y1, area->x2, area->y2);
+        if (count < LAYER_STATE_MAX_DAMAGE) {
+            rects[count++] = rect;
+            continue;
+        }
+
+        /* out of slots, grow the rect whose bounds grow least */
+        uint32_t best = 0;
+        int64_t bestGrowth = INT64_MAX;
+        for (uint32_t j = 0; j < count; j++) {
+            int64_t w = std::max(rects[j].right, rect.right) - std::min(rects[j].left, rect.left);
+            int64_t h = std::max(rects[j].bottom, rect.bottom) - std::min(rects[j].top, rect.top);
+            int64_t growth = (w + 1) * (h + 1) -
+                    (int64_t)(rects[j].right - rects[j].left + 1) *
+                            (rects[j].bottom - rects[j].top + 1);
+            if (growth < bestGrowth) {
+                bestGrowth = growth;
+                best = j;
+            }
+        }
+        rects[best].left = std::min(rects[best].left, rect.left);
+        rects[best].top = std::min(rects[best].top, rect.top);
+        rects[best].right = std::max(rects[best].right, rect.right);
+        rects[best].bottom = std::max(rects[best].bottom, rect.bottom);
     }
+    return count;
 }
 
 void LVGLDriverProxy::onResolutionChanged(int32_t width, int32_t height) {
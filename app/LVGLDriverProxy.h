@@ -64,6 +64,7 @@ public:
     void onResolutionChanged(int32_t width, int32_t height);
     void onRenderStart();
     void onRenderEnd();
+    uint32_t collectDamage(Rect* rects);
 
     int renderMode() {
         return mRenderMode;
@@ -46,11 +46,15 @@ SurfaceTransaction& SurfaceTransaction::setBuffer(const std::shared_ptr<SurfaceC
 
 SurfaceTransaction& SurfaceTransaction::setBufferCrop(const std::shared_ptr<SurfaceControl>& sc,
                                                       Rect& rect) {
+    return setBufferDamage(sc, &rect, 1);
+}
+
+SurfaceTransaction& SurfaceTransaction::setBufferDamage(const std::shared_ptr<SurfaceControl>& sc,
+                                                        const Rect* rects, uint32_t count) {
     LayerState* state = getLayerState(sc);
 
     if (state != nullptr) {
-        state->mFlags |= LayerState::LAYER_BUFFER_CROP_CHANGED;
-        state->mBufferCrop = rect;
+        state->setDamage(rects, count);
     }
     return *this;
 }
@@ -95,13 +99,15 @@ SurfaceTransaction& SurfaceTransaction::apply() {
     for (std::unordered_map<sp<IBinder>, LayerState, IBinderHash>::iterator it =
                  mLayerStates.begin();
          it != mLayerStates.end(); ++it) {
-        if (it->second.mFlags != 0) {
+        if (it->second.mFlags != 0 && !writeToChannel(it->first, it->second)) {
             layerStates.push_back(it->second);
         }
     }
 
     WM_PROFILER_END();
-    mWindowManager->getService()->applyTransaction(layerStates);
+    if (!layerStates.empty()) {
+        mWindowManager->getService()->applyTransaction(layerStates);
+    }
 
     /* reset flags */
     for (std::unordered_map<sp<IBinder>, LayerState, IBinderHash>::iterator it =
@@ -115,6 +121,30 @@ SurfaceTransaction& SurfaceTransaction::apply() {
 
 void SurfaceTransaction::clean() {
     mLayerStates.clear();
+    mSurfaces.clear();
+}
+
+bool SurfaceTransaction::writeToChannel(const sp<IBinder>& token, const LayerState& state) {
+    auto it = mSurfaces.find(token);
+    if (it == mSurfaces.end()) {
+        return false;
+    }
+
+    std::shared_ptr<SurfaceControl> sc = it->second.lock();
+    if (sc.get() == nullptr) {
+        return false;
+    }
+
+    /* binder is the fallback when the channel is absent or full */
+    LayerStateRecord record;
+    state.toRecord(&record);
+    auto& fmq = sc->getTransactionFMQ();
+    if (fmq.getEventFd() < 0 || !fmq.write(&record)) {
+        return false;
+    }
+
+    fmq.notify();
+    return true;
 }
 
 LayerState* SurfaceTransaction::getLayerState(const std::shared_ptr<SurfaceControl>& sc) {
@@ -127,6 +157,7 @@ LayerState* SurfaceTransaction::getLayerState(const std::shared_ptr<SurfaceContr
         LayerState s(key);
         mLayerStates[key] = s;
     }
+    mSurfaces[key] = sc;
 
     return &mLayerStates[key];
 }
@@ -19,6 +19,7 @@
 
 #include <binder/IBinder.h>
 
+#include <memory>
 #include <unordered_map>
 
 #include "WindowManager.h"
@@ -49,6 +50,8 @@ public:
     SurfaceTransaction& setBuffer(const std::shared_ptr<SurfaceControl>& sc, BufferItem& item,
                                   uint32_t seq);
     SurfaceTransaction& setBufferCrop(const std::shared_ptr<SurfaceControl>& sc, Rect& rect);
+    SurfaceTransaction& setBufferDamage(const std::shared_ptr<SurfaceControl>& sc,
+                                        const Rect* rects, uint32_t count);
 
     SurfaceTransaction& setPosition(const std::shared_ptr<SurfaceControl>& sc, int32_t x,
                                     int32_t y);
@@ -66,8 +69,10 @@ public:
 
 private:
     LayerState* getLayerState(const std::shared_ptr<SurfaceControl>& sc);
+    bool writeToChannel(const sp<IBinder>& token, const LayerState& state);
 
     std::unordered_map<sp<IBinder>, LayerState, IBinderHash> mLayerStates;
+    std::unordered_map<sp<IBinder>, std::weak_ptr<SurfaceControl>, IBinderHash> mSurfaces;
     WindowManager* mWindowManager;
 };
 
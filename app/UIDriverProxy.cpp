@@ -16,6 +16,8 @@
 
 #include "UIDriverProxy.h"
 
+#include <algorithm>
+
 #include "../common/WindowUtils.h"
 #include "BaseWindow.h"
 #include "os/wm/VsyncRequest.h"
@@ -26,6 +28,7 @@ namespace wm {
 UIDriverProxy::UIDriverProxy(std::shared_ptr<BaseWindow> win)
       : mBaseWindow(win),
         mBufferItem(nullptr),
+        mDamageCount(0),
         mFlags(0),
         mInputMonitor(nullptr),
         mEventListener(nullptr),
@@ -46,14 +49,45 @@ bool UIDriverProxy::onInvalidate(bool periodic) {
 }
 
 void UIDriverProxy::onRectCrop(Rect& rect) {
-    mFlags |= UIP_BUFFER_RECT_UPDATE;
-    mRectCrop = rect;
+    onDamageRects(&rect, 1);
 }
 
 Rect* UIDriverProxy::rectCrop() {
     return ((mFlags & UIP_BUFFER_RECT_UPDATE) == UIP_BUFFER_RECT_UPDATE) ? &mRectCrop : nullptr;
 }
 
+void UIDriverProxy::onDamageRects(const Rect* rects, uint32_t count) {
+    if (!rects || count == 0) return;
+
+    mRectCrop = rects[0];
+    for (uint32_t i = 1; i < count; i++) {
+        mRectCrop.left = std::min(mRectCrop.left, rects[i].left);
+        mRectCrop.top = std::min(mRectCrop.top, rects[i].top);
+        mRectCrop.right = std::max(mRectCrop.right, rects[i].right);
+        mRectCrop.bottom = std::max(mRectCrop.bottom, rects[i].bottom);
+    }
+
+    if (count > LAYER_STATE_MAX_DAMAGE) {
+        mDamageRects[0] = mRectCrop;
+        mDamageCount = 1;
+    } else {
+        for (uint32_t i = 0; i < count; i++) {
+            mDamageRects[i] = rects[i];
+        }
+        mDamageCount = count;
+    }
+    mFlags |= UIP_BUFFER_RECT_UPDATE;
+}
+
+const Rect* UIDriverProxy::damageRects(uint32_t* count) {
+    if ((mFlags & UIP_BUFFER_RECT_UPDATE) != UIP_BUFFER_RECT_UPDATE) {
+        *count = 0;
+        return nullptr;
+    }
+    *count = mDamageCount;
+    return mDamageRects;
+}
+
 void* UIDriverProxy::onDequeueBuffer() {
     return (mBufferItem->mState == BSTATE_DEQUEUED) ? mBufferItem->mBuffer : nullptr;
 }
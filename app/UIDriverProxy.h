@@ -21,6 +21,7 @@
 #include "wm/BufferQueue.h"
 #include "wm/InputMessage.h"
 #include "wm/InputMonitor.h"
+#include "wm/LayerState.h"
 #include "wm/Rect.h"
 
 namespace os {
@@ -48,6 +49,9 @@ public:
 
     void onRectCrop(Rect& rect);
     Rect* rectCrop();
+    /* damaged rects of the queued buffer, rectCrop is their bounds */
+    void onDamageRects(const Rect* rects, uint32_t count);
+    const Rect* damageRects(uint32_t* count);
 
     BufferItem* getBufferItem() {
         return mBufferItem;
@@ -99,6 +103,8 @@ private:
     std::weak_ptr<BaseWindow> mBaseWindow;
     BufferItem* mBufferItem;
     Rect mRectCrop;
+    Rect mDamageRects[LAYER_STATE_MAX_DAMAGE];
+    uint32_t mDamageCount;
     int8_t mFlags;
     InputMonitor* mInputMonitor;
     WindowEventListener* mEventListener;
@@ -17,15 +17,50 @@
 
 #include "wm/BufferQueue.h"
 
+#include <string.h>
 #include <sys/mman.h>
 
 #include "WindowUtils.h"
+#include "wm/BufferStateTable.h"
 #include "wm/SurfaceControl.h"
 
 namespace os {
 namespace wm {
 
-BufferQueue::BufferQueue(const std::shared_ptr<SurfaceControl>& sc) {
+static inline bool ringContains(const BufferRing& ring, int32_t index) {
+    return ring.mMask & (1u << index);
+}
+
+static inline void ringPush(BufferRing& ring, int32_t index) {
+    ring.mIndex[(ring.mHead + ring.mCount) % BUFFER_QUEUE_MAX_SLOTS] = index;
+    ring.mCount++;
+    ring.mMask |= 1u << index;
+}
+
+static inline void ringRemove(BufferRing& ring, int32_t index) {
+    ring.mMask &= ~(1u << index);
+
+    // buffers are normally consumed in FIFO order
+    if (ring.mIndex[ring.mHead] == index) {
+        ring.mHead = (ring.mHead + 1) % BUFFER_QUEUE_MAX_SLOTS;
+        ring.mCount--;
+        return;
+    }
+
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < ring.mCount; i++) {
+        uint8_t value = ring.mIndex[(ring.mHead + i) % BUFFER_QUEUE_MAX_SLOTS];
+        if (value != index) {
+            ring.mIndex[(ring.mHead + count) % BUFFER_QUEUE_MAX_SLOTS] = value;
+            count++;
+        }
+    }
+    ring.mCount = count;
+}
+
+BufferQueue::BufferQueue(const std::shared_ptr<SurfaceControl>& sc) : mBufferCount(0) {
+    memset(&mDataSlot, 0, sizeof(mDataSlot));
+    memset(&mFreeSlot, 0, sizeof(mFreeSlot));
     update(sc);
 }
 
@@ -33,63 +68,102 @@ BufferQueue::~BufferQueue() {
     mSurfaceControl.reset();
 
     FLOGI(" ");
-    if (!mBuffers.empty()) {
+    if (mBufferCount > 0) {
         clearBuffers();
     }
-
-    mDataSlot.clear();
-    mFreeSlot.clear();
 }
 
 BufferItem* BufferQueue::getBuffer(BufferKey bufKey) {
-    if (mBuffers.find(bufKey) != mBuffers.end()) {
-        return &mBuffers[bufKey];
+    // the table holds at most BUFFER_QUEUE_MAX_SLOTS entries
+    for (uint32_t i = 0; i < mBufferCount; i++) {
+        if (mBuffers[i].mKey == bufKey) {
+            return &mBuffers[i];
+        }
     }
     return nullptr;
 }
 
+int32_t BufferQueue::indexOf(const BufferItem* item) const {
+    if (item < mBuffers || item >= mBuffers + mBufferCount) {
+        return -1;
+    }
+    return item - mBuffers;
+}
+
 // after dequeue or acquire buffer, allow to cancel buffer
 bool BufferQueue::cancelBuffer(BufferItem* item) {
     return toState(item, BSTATE_FREE);
 }
 
 void BufferQueue::clearBuffers() {
-    for (auto it = mBuffers.begin(); it != mBuffers.end(); ++it) {
-        it->second.mUserData = nullptr;
+    for (uint32_t i = 0; i < mBufferCount; i++) {
+        BufferItem& item = mBuffers[i];
+        item.mUserData = nullptr;
 
-        FLOGI("now unmap and close shared memory for %d", it->second.mFd);
+        FLOGI("now unmap and close shared memory for %d", item.mFd);
 
-        if (it->second.mBuffer && munmap(it->second.mBuffer, it->second.mSize) == -1) {
-            FLOGE("failed to unmap shared memory for %d", it->second.mFd);
+        if (item.mBuffer && munmap(item.mBuffer, item.mSize) == -1) {
+            FLOGE("failed to unmap shared memory for %d", item.mFd);
         }
 
-        if (close(it->second.mFd) == -1) {
-            FLOGE("failed to close shared memory for %d", it->second.mFd);
+        if (close(item.mFd) == -1) {
+            FLOGE("failed to close shared memory for %d", item.mFd);
         }
     }
-    mBuffers.clear();
+    mBufferCount = 0;
+    mStateTable.reset();
+    memset(&mDataSlot, 0, sizeof(mDataSlot));
+    memset(&mFreeSlot, 0, sizeof(mFreeSlot));
 }
 
 BufferItem* BufferQueue::syncState(BufferKey key, BufferState byState) {
     BufferItem* item = getBuffer(key);
     if (!item) return nullptr;
 
+    // the other side has already published the state, only follow it locally
+    if (mStateTable && mStateTable->load(indexOf(item)) != byState) {
+        return nullptr;
+    }
+
     if (item->mState == BSTATE_QUEUED && byState == BSTATE_FREE) {
         // sync consumer free byState to producer
-        if (toState(item, BSTATE_FREE)) return item;
+        if (toState(item, BSTATE_FREE, false)) return item;
     } else if (item->mState == BSTATE_FREE && byState == BSTATE_QUEUED) {
         // sync producer queue byState to consumer
-        if (toState(item, BSTATE_QUEUED)) return item;
+        if (toState(item, BSTATE_QUEUED, false)) return item;
     }
     return nullptr;
 }
 
+void BufferQueue::syncSharedState() {
+    if (!mStateTable) return;
+
+    for (uint32_t i = 0; i < mBufferCount; i++) {
+        BufferItem* item = &mBuffers[i];
+        if (item->mState == BSTATE_QUEUED && mStateTable->load(i) == BSTATE_FREE) {
+            toState(item, BSTATE_FREE, false);
+        }
+    }
+}
+
+uint32_t BufferQueue::sharedReleasedCount() const {
+    if (!mStateTable) return 0;
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < mBufferCount; i++) {
+        if (mBuffers[i].mState == BSTATE_QUEUED && mStateTable->load(i) == BSTATE_FREE) {
+            count++;
+        }
+    }
+    return count;
+}
+
 bool BufferQueue::update(const std::shared_ptr<SurfaceControl>& sc) {
     if (sc->isSameSurface(sc, mSurfaceControl.lock())) {
         return false;
     }
 
-    if (!mBuffers.empty()) {
+    if (mBufferCount > 0) {
         clearBuffers();
     }
 
@@ -98,6 +172,11 @@ bool BufferQueue::update(const std::shared_ptr<SurfaceControl>& sc) {
     auto bufferIds = sc->bufferIds();
     uint32_t size = sc->getBufferSize();
 
+    if (bufferIds.size() > BUFFER_QUEUE_MAX_SLOTS) {
+        FLOGE("too many buffers(%zu), max is %d", bufferIds.size(), BUFFER_QUEUE_MAX_SLOTS);
+        return false;
+    }
+
     for (const auto& id : bufferIds) {
         BufferKey bufferkey = id.mKey;
         int bufferFd = id.mFd;
@@ -114,112 +193,125 @@ bool BufferQueue::update(const std::shared_ptr<SurfaceControl>& sc) {
         }
 
         FLOGI("map shared memory success for %d", bufferFd);
-        BufferItem buffItem = {bufferkey, bufferFd, buffer, size, BSTATE_FREE, nullptr};
-        mBuffers[bufferkey] = buffItem;
-        mFreeSlot.push_back(bufferkey);
+        mBuffers[mBufferCount] = {bufferkey, bufferFd, buffer, size, BSTATE_FREE, nullptr, 0};
+        ringPush(mFreeSlot, mBufferCount);
+        mBufferCount++;
+    }
+
+    auto table = sc->getBufferState();
+    if (table && table->isValid()) {
+        bool matched = table->count() == mBufferCount;
+        for (uint32_t i = 0; matched && i < mBufferCount; i++) {
+            matched = table->keyAt(i) == mBuffers[i].mKey;
+        }
+
+        if (matched) {
+            mStateTable = table;
+        } else {
+            FLOGE("buffer state table doesn't match buffers, sync state by messages");
+        }
     }
     return true;
 }
 
-bool BufferQueue::toState(BufferItem* item, BufferState state) {
+bool BufferQueue::toState(BufferItem* item, BufferState state, bool publish) {
+    int32_t index = indexOf(item);
+    if (index < 0) {
+        return false;
+    }
+
+    BufferRing* leave = nullptr;
+    BufferRing* join = nullptr;
+
     /*
      * PRODUCER: FREE <-> DEQUEUED -> QUEUED -> FREE
      * CONSUMER: FREE <-> QUEUED -> ACQUIRED -> FREE
      */
     switch (item->mState) {
         case BSTATE_FREE:
-            if (state == BSTATE_DEQUEUED) {
-                // check it in free slot
-                auto it = std::find(mFreeSlot.begin(), mFreeSlot.end(), item->mKey);
-                if (it == mFreeSlot.end()) {
-                    return false;
-                }
-                // remove from free slot and update state
-                mFreeSlot.remove(item->mKey);
-                item->mState = state;
-                return true;
-            } else if (state == BSTATE_QUEUED) {
-                // move it from free slot to data slot
-                auto it = std::find(mFreeSlot.begin(), mFreeSlot.end(), item->mKey);
-                if (it == mFreeSlot.end()) {
-                    return false;
-                }
-                mFreeSlot.remove(item->mKey);
-                mDataSlot.push_back(item->mKey);
-                item->mState = state;
-                return true;
+            // leave free slot, a queued buffer joins data slot
+            if ((state != BSTATE_DEQUEUED && state != BSTATE_QUEUED) ||
+                !ringContains(mFreeSlot, index)) {
+                return false;
             }
+            leave = &mFreeSlot;
+            join = state == BSTATE_QUEUED ? &mDataSlot : nullptr;
             break;
 
         case BSTATE_DEQUEUED:
-            if (state == BSTATE_QUEUED) {
-                // move to data slot and update state
-                auto it = std::find(mDataSlot.begin(), mDataSlot.end(), item->mKey);
-                if (it != mDataSlot.end()) {
-                    return false;
-                }
-                mDataSlot.push_back(item->mKey);
-                item->mState = state;
-                return true;
-            } else if (state == BSTATE_FREE) {
-                // move to free slot and update state
-                auto it = std::find(mFreeSlot.begin(), mFreeSlot.end(), item->mKey);
-                if (it != mFreeSlot.end()) {
-                    return false;
-                }
-                mFreeSlot.push_back(item->mKey);
-                item->mState = state;
-                return true;
+            // join data slot when queued, or free slot when canceled
+            if (state != BSTATE_QUEUED && state != BSTATE_FREE) {
+                return false;
             }
-            break;
-
-        case BSTATE_QUEUED:
-            if (state == BSTATE_ACQUIRED) {
-                // update state, buffer in data slot
-                item->mState = state;
-                return true;
-            } else if (state == BSTATE_FREE) {
-                // move it from data slot to free slot and update state
-                auto it = std::find(mDataSlot.begin(), mDataSlot.end(), item->mKey);
-                if (it == mDataSlot.end()) {
-                    return false;
-                }
-                mDataSlot.remove(item->mKey);
-                mFreeSlot.push_back(item->mKey);
-                item->mState = state;
-                return true;
+            join = state == BSTATE_QUEUED ? &mDataSlot : &mFreeSlot;
+            if (ringContains(*join, index)) {
+                return false;
             }
             break;
 
+        case BSTATE_QUEUED:
         case BSTATE_ACQUIRED:
-            if (state == BSTATE_FREE) {
-                // move it from data slot to free slot and update state
-                auto it = std::find(mDataSlot.begin(), mDataSlot.end(), item->mKey);
-                if (it == mDataSlot.end()) {
-                    return false;
-                }
-                mDataSlot.remove(item->mKey);
-                mFreeSlot.push_back(item->mKey);
-                item->mState = state;
-                return true;
+            // an acquired buffer stays in data slot
+            if (state == BSTATE_ACQUIRED && item->mState == BSTATE_QUEUED) {
+                break;
+            }
+            // move it from data slot to free slot
+            if (state != BSTATE_FREE || !ringContains(mDataSlot, index)) {
+                return false;
             }
+            leave = &mDataSlot;
+            join = &mFreeSlot;
             break;
 
         default:
-            break;
+            return false;
     }
-    return false;
+
+    if (publish && mStateTable && !mStateTable->compareAndSet(index, item->mState, state)) {
+        FLOGW("buffer %" PRId32 " is owned by the other side", item->mKey);
+        return false;
+    }
+
+    if (leave) ringRemove(*leave, index);
+    if (join) ringPush(*join, index);
+    item->mState = state;
+    return true;
 }
 
-BufferItem* BufferQueue::getBuffer(BufferSlot slot) {
-    BufferKey key = -1;
+void BufferQueue::updateBufferAge(BufferItem* queued, const Rect* damage) {
+    for (uint32_t i = 0; i < mBufferCount; i++) {
+        BufferItem& item = mBuffers[i];
+        if (&item == queued) {
+            item.mAge = 1;
+            continue;
+        }
+
+        if (item.mAge == 0) continue;
 
-    if (slot == BSLOT_FREE && !mFreeSlot.empty()) {
-        key = mFreeSlot.front();
-    } else if (slot == BSLOT_DATA && !mDataSlot.empty()) {
-        key = mDataSlot.front();
+        // unknown damage, the whole content is outdated
+        if (damage == nullptr) {
+            item.mAge = 0;
+            continue;
+        }
+
+        if (item.mAge == 1) {
+            item.mDamage = *damage;
+        } else {
+            item.mDamage.left = DATA_MIN(item.mDamage.left, damage->left);
+            item.mDamage.top = DATA_MIN(item.mDamage.top, damage->top);
+            item.mDamage.right = DATA_MAX(item.mDamage.right, damage->right);
+            item.mDamage.bottom = DATA_MAX(item.mDamage.bottom, damage->bottom);
+        }
+        item.mAge++;
+    }
+}
+
+BufferItem* BufferQueue::getBuffer(BufferSlot slot) {
+    const BufferRing& ring = slot == BSLOT_FREE ? mFreeSlot : mDataSlot;
+    if (ring.mCount == 0) {
+        return nullptr;
     }
-    return getBuffer(key);
+    return &mBuffers[ring.mIndex[ring.mHead]];
 }
 
 } // namespace wm
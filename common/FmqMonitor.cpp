@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "FmqMonitor"
+
+#include "FmqMonitor.h"
+
+#include "WindowUtils.h"
+
+namespace os {
+namespace wm {
+
+FmqMonitor::FmqMonitor() : mPoll(nullptr), mCallback(nullptr) {}
+
+FmqMonitor::~FmqMonitor() {
+    stop();
+}
+
+void FmqMonitor::stop() {
+    if (mPoll) {
+        uv_poll_stop(mPoll);
+        mPoll->data = nullptr;
+        uv_close(reinterpret_cast<uv_handle_t*>(mPoll),
+                 [](uv_handle_t* handle) { delete reinterpret_cast<uv_poll_t*>(handle); });
+        mPoll = nullptr;
+    }
+    mCallback = nullptr;
+}
+
+bool FmqMonitor::start(uv_loop_t* loop, int fd, FmqMonitorCallback callback) {
+    if (loop == nullptr || fd < 0 || callback == nullptr) {
+        FLOGE("invalid loop, fd(%d) or callback", fd);
+        return false;
+    }
+
+    stop();
+
+    mPoll = new uv_poll_t;
+    int ret = uv_poll_init(loop, mPoll, fd);
+    if (ret != 0) {
+        FLOGE("init monitor fd(%d) failure:%d", fd, ret);
+        delete mPoll;
+        mPoll = nullptr;
+        return false;
+    }
+
+    mPoll->data = this;
+    mCallback = callback;
+
+    ret = uv_poll_start(mPoll, UV_READABLE, [](uv_poll_t* handle, int status, int events) {
+        if (status < 0) {
+            FLOGE("Poll error: %s ", uv_strerror(status));
+            return;
+        }
+
+        FmqMonitor* monitor = reinterpret_cast<FmqMonitor*>(handle->data);
+        if ((events & UV_READABLE) && monitor && monitor->mCallback) {
+            /* the callback may stop this monitor */
+            FmqMonitorCallback callback = monitor->mCallback;
+            callback();
+        }
+    });
+
+    if (ret != 0) {
+        FLOGE("start monitor(%d) failure:%d", fd, ret);
+        stop();
+        return false;
+    }
+
+    FLOGI("start monitor(%d) success", fd);
+    return true;
+}
+
+} // namespace wm
+} // namespace os
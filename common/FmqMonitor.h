@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <uv.h>
+
+#include <functional>
+
+namespace os {
+namespace wm {
+
+typedef std::function<void()> FmqMonitorCallback;
+
+/* watch the eventfd paired with a FakeFmq on a uv loop */
+class FmqMonitor {
+public:
+    FmqMonitor();
+    ~FmqMonitor();
+
+    bool start(uv_loop_t* loop, int fd, FmqMonitorCallback callback);
+    void stop();
+
+    bool isActive() const {
+        return mPoll != nullptr;
+    }
+
+private:
+    uv_poll_t* mPoll;
+    FmqMonitorCallback mCallback;
+};
+
+} // namespace wm
+} // namespace os
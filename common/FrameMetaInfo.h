@@ -40,6 +40,10 @@ enum class FrameMetaIndex {
     // for XMS arch
     SyncQueued,
     FrameFinished,
+
+    // frame timeline from the server vsync
+    Deadline,
+    PresentTime,
     NumIndexes
 };
 
@@ -53,6 +57,7 @@ enum class FrameMetaSkipReason {
     NoSurface,
     NothingToDraw,
     NoBuffer,
+    MissedDeadline,
 };
 
 class FrameMetaInfo {
@@ -77,6 +82,11 @@ public:
         set(FrameMetaIndex::FrameInterval) = frameIntervalMs;
     }
 
+    void setFrameTimeline(int64_t deadline, int64_t presentTime) {
+        set(FrameMetaIndex::Deadline) = deadline;
+        set(FrameMetaIndex::PresentTime) = presentTime;
+    }
+
     const int64_t* data() const {
         return mMetaData;
     }
@@ -102,6 +112,12 @@ public:
     inline int64_t getVsyncId() const {
         return get(FrameMetaIndex::VsyncId);
     }
+    inline int64_t getDeadline() const {
+        return get(FrameMetaIndex::Deadline);
+    }
+    inline int64_t getPresentTime() const {
+        return get(FrameMetaIndex::PresentTime);
+    }
     inline int64_t duration(FrameMetaIndex start, FrameMetaIndex end) const {
         int64_t endTime = get(end);
         int64_t startTime = get(start);
@@ -135,6 +151,11 @@ public:
         return duration(FrameMetaIndex::LayoutStart, FrameMetaIndex::RenderStart);
     }
 
+    /* time the frame finished after its deadline, 0 when it made it */
+    inline int64_t deadlineOverrun() const {
+        return duration(FrameMetaIndex::Deadline, FrameMetaIndex::FrameFinished);
+    }
+
     void addFlag(int flag) {
         set(FrameMetaIndex::Flags) |= static_cast<uint64_t>(flag);
     }
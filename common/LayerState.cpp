@@ -18,9 +18,80 @@
 
 #include "wm/Rect.h"
 
+#include <algorithm>
+
 namespace os {
 namespace wm {
 
+void LayerState::merge(LayerState& state) {
+    if (state.mFlags & LAYER_POSITION_CHANGED) {
+        mX = state.mX;
+        mY = state.mY;
+    }
+
+    if (state.mFlags & LAYER_ALPHA_CHANGED) {
+        mAlpha = state.mAlpha;
+    }
+
+    if (state.mFlags & LAYER_BUFFER_CHANGED) {
+        bool skipped = mFlags & LAYER_BUFFER_CHANGED;
+
+        /* the newer buffer also carries what changed in the skipped one */
+        if (!(state.mFlags & LAYER_BUFFER_CROP_CHANGED)) {
+            mFlags &= ~LAYER_BUFFER_CROP_CHANGED;
+        } else if (!skipped) {
+            if (state.mDamageCount > 0) {
+                setDamage(state.mDamage, state.mDamageCount);
+            } else {
+                setDamage(&state.mBufferCrop, 1);
+            }
+        } else if (mFlags & LAYER_BUFFER_CROP_CHANGED) {
+            mBufferCrop.left = std::min(mBufferCrop.left, state.mBufferCrop.left);
+            mBufferCrop.top = std::min(mBufferCrop.top, state.mBufferCrop.top);
+            mBufferCrop.right = std::max(mBufferCrop.right, state.mBufferCrop.right);
+            mBufferCrop.bottom = std::max(mBufferCrop.bottom, state.mBufferCrop.bottom);
+
+            if (mDamageCount > 0 && state.mDamageCount > 0 &&
+                mDamageCount + state.mDamageCount <= LAYER_STATE_MAX_DAMAGE) {
+                for (uint32_t i = 0; i < state.mDamageCount; i++) {
+                    mDamage[mDamageCount++] = state.mDamage[i];
+                }
+            } else {
+                mDamage[0] = mBufferCrop;
+                mDamageCount = 1;
+            }
+        }
+        mBufferKey = state.mBufferKey;
+        /* the seq belongs to the buffer, other changes keep the pending one */
+        mSeq = state.mSeq;
+    }
+
+    mFlags |= state.mFlags & (LAYER_POSITION_CHANGED | LAYER_ALPHA_CHANGED | LAYER_BUFFER_CHANGED);
+}
+
+void LayerState::setDamage(const Rect* rects, uint32_t count) {
+    if (count == 0) return;
+
+    mBufferCrop = rects[0];
+    for (uint32_t i = 1; i < count; i++) {
+        mBufferCrop.left = std::min(mBufferCrop.left, rects[i].left);
+        mBufferCrop.top = std::min(mBufferCrop.top, rects[i].top);
+        mBufferCrop.right = std::max(mBufferCrop.right, rects[i].right);
+        mBufferCrop.bottom = std::max(mBufferCrop.bottom, rects[i].bottom);
+    }
+
+    if (count > LAYER_STATE_MAX_DAMAGE) {
+        mDamage[0] = mBufferCrop;
+        mDamageCount = 1;
+    } else {
+        for (uint32_t i = 0; i < count; i++) {
+            mDamage[i] = rects[i];
+        }
+        mDamageCount = count;
+    }
+    mFlags |= LAYER_BUFFER_CROP_CHANGED;
+}
+
 status_t LayerState::writeToParcel(Parcel* out) const {
     SAFE_PARCEL(out->writeStrongBinder, mToken);
     SAFE_PARCEL(out->writeInt32, mFlags);
@@ -37,6 +108,10 @@ status_t LayerState::writeToParcel(Parcel* out) const {
 
     if (mFlags & LAYER_BUFFER_CROP_CHANGED) {
         mBufferCrop.writeToParcel(out);
+        SAFE_PARCEL(out->writeUint32, mDamageCount);
+        for (uint32_t i = 0; i < mDamageCount; i++) {
+            mDamage[i].writeToParcel(out);
+        }
     }
 
     if (mFlags & LAYER_ALPHA_CHANGED) {
@@ -61,6 +136,11 @@ status_t LayerState::readFromParcel(const Parcel* in) {
 
     if (mFlags & LAYER_BUFFER_CROP_CHANGED) {
         mBufferCrop.readFromParcel(in);
+        SAFE_PARCEL(in->readUint32, &mDamageCount);
+        if (mDamageCount > LAYER_STATE_MAX_DAMAGE) return android::BAD_VALUE;
+        for (uint32_t i = 0; i < mDamageCount; i++) {
+            mDamage[i].readFromParcel(in);
+        }
     }
 
     if (mFlags & LAYER_ALPHA_CHANGED) {
@@ -69,5 +149,37 @@ status_t LayerState::readFromParcel(const Parcel* in) {
     return android::OK;
 }
 
+void LayerState::toRecord(LayerStateRecord* record) const {
+    record->mFlags = mFlags;
+    record->mSeq = mSeq;
+    record->mX = mX;
+    record->mY = mY;
+    record->mAlpha = mAlpha;
+    record->mBufferKey = mBufferKey;
+    record->mBufferCrop = mBufferCrop;
+    record->mDamageCount = mDamageCount;
+    for (uint32_t i = 0; i < mDamageCount; i++) {
+        record->mDamage[i] = mDamage[i];
+    }
+}
+
+void LayerState::fromRecord(const LayerStateRecord& record) {
+    mFlags = record.mFlags;
+    mSeq = record.mSeq;
+    mX = record.mX;
+    mY = record.mY;
+    mAlpha = record.mAlpha;
+    mBufferKey = record.mBufferKey;
+    mBufferCrop.left = record.mBufferCrop.left;
+    mBufferCrop.top = record.mBufferCrop.top;
+    mBufferCrop.right = record.mBufferCrop.right;
+    mBufferCrop.bottom = record.mBufferCrop.bottom;
+    mDamageCount = std::min(record.mDamageCount, (uint32_t)LAYER_STATE_MAX_DAMAGE);
+    for (uint32_t i = 0; i < mDamageCount; i++) {
+        mDamage[i] = Rect(record.mDamage[i].left, record.mDamage[i].top, record.mDamage[i].right,
+                          record.mDamage[i].bottom);
+    }
+}
+
 } // namespace wm
 } // namespace os
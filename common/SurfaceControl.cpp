@@ -20,6 +20,9 @@
 
 #include <sys/mman.h>
 #include <sys/stat.h>
+#ifdef CONFIG_ENABLE_FMQ_EVENTFD
+#include <sys/eventfd.h>
+#endif
 
 #include "WindowUtils.h"
 
@@ -33,7 +36,7 @@ bool SurfaceControl::isSameSurface(const std::shared_ptr<SurfaceControl>& lhs,
     return lhs->mHandle == rhs->mHandle;
 }
 
-SurfaceControl::SurfaceControl() {}
+SurfaceControl::SurfaceControl() : mBufferState(std::make_shared<BufferStateTable>()) {}
 
 SurfaceControl::SurfaceControl(const sp<IBinder>& token, const sp<IBinder>& handle, uint32_t width,
                                uint32_t height, uint32_t format, uint32_t size)
@@ -42,7 +45,8 @@ SurfaceControl::SurfaceControl(const sp<IBinder>& token, const sp<IBinder>& hand
         mWidth(width),
         mHeight(height),
         mFormat(format),
-        mBufferSize(size) {
+        mBufferSize(size),
+        mBufferState(std::make_shared<BufferStateTable>()) {
     FLOGI("%p create surface for handle %p \n", this, mHandle.get());
 }
 
@@ -74,6 +78,15 @@ status_t SurfaceControl::writeToParcel(Parcel* out) const {
 
     if (mBufferIds.size() > 0) {
         mFreeMsgSlot.writeToParcel(out);
+#ifdef CONFIG_ENABLE_TRANSACTION_CHANNEL
+        mTransactionSlot.writeToParcel(out);
+#endif
+#ifdef CONFIG_ENABLE_VSYNC_CHANNEL
+        mVsyncSlot.writeToParcel(out);
+#endif
+#ifdef CONFIG_ENABLE_SHARED_BUFFER_STATE
+        mBufferState->writeToParcel(out);
+#endif
     }
     return android::OK;
 }
@@ -103,6 +116,15 @@ status_t SurfaceControl::readFromParcel(const Parcel* in) {
 
     if (size > 0) {
         mFreeMsgSlot.readFromParcel(in);
+#ifdef CONFIG_ENABLE_TRANSACTION_CHANNEL
+        mTransactionSlot.readFromParcel(in);
+#endif
+#ifdef CONFIG_ENABLE_VSYNC_CHANNEL
+        mVsyncSlot.readFromParcel(in);
+#endif
+#ifdef CONFIG_ENABLE_SHARED_BUFFER_STATE
+        mBufferState->readFromParcel(in);
+#endif
     }
     return android::OK;
 }
@@ -129,6 +151,9 @@ void SurfaceControl::copyFrom(SurfaceControl& other) {
     mBufferSize = other.mBufferSize;
     mBufferIds = other.mBufferIds;
     mFreeMsgSlot.copyFrom(other.mFreeMsgSlot);
+    mTransactionSlot.copyFrom(other.mTransactionSlot);
+    mVsyncSlot.copyFrom(other.mVsyncSlot);
+    mBufferState->copyFrom(*other.mBufferState);
 }
 
 bool SurfaceControl::initFMQ(bool isServer) {
@@ -146,6 +171,43 @@ void SurfaceControl::destroyFMQ() {
     mFreeMsgSlot.destroy();
 }
 
+bool SurfaceControl::initTransactionFMQ(bool isServer) {
+    if (isValid()) {
+        return mTransactionSlot.create({}, isServer, SURFACE_TRANSACTION_CAPS);
+    }
+    return false;
+}
+
+void SurfaceControl::destroyTransactionFMQ() {
+    mTransactionSlot.destroy();
+}
+
+bool SurfaceControl::initVsyncFMQ(bool isServer) {
+    if (isValid()) {
+        return mVsyncSlot.create({}, isServer, SURFACE_VSYNC_CAPS);
+    }
+    return false;
+}
+
+void SurfaceControl::destroyVsyncFMQ() {
+    mVsyncSlot.destroy();
+}
+
+bool SurfaceControl::initBufferState(bool isServer) {
+    if (isValid()) {
+        std::vector<BufferKey> bufKeys;
+        for (const auto& id : mBufferIds) {
+            bufKeys.push_back(id.mKey);
+        }
+        return mBufferState->create(bufKeys, isServer);
+    }
+    return false;
+}
+
+void SurfaceControl::destroyBufferState() {
+    mBufferState->destroy();
+}
+
 static inline bool initSharedBuffer(std::string name, int* pfd, int32_t size) {
     int32_t flag = O_RDWR | O_CLOEXEC;
 
@@ -194,6 +256,12 @@ void initSurfaceBuffer(const std::shared_ptr<SurfaceControl>& sc, bool isServer)
     for (const auto& id : bufferIds) {
         int fd = -1;
 
+        /* recycled buffer, shared memory is still open */
+        if (isServer && id.mFd > 0) {
+            ids.push_back(id);
+            continue;
+        }
+
         if (!initSharedBuffer(id.mName, &fd, size)) {
             result = false;
             break;
@@ -215,24 +283,45 @@ void initSurfaceBuffer(const std::shared_ptr<SurfaceControl>& sc, bool isServer)
     /* update buffer ids*/
     sc->initBufferIds(ids);
     sc->initFMQ(isServer);
+#ifdef CONFIG_ENABLE_TRANSACTION_CHANNEL
+    sc->initTransactionFMQ(isServer);
+#endif
+#ifdef CONFIG_ENABLE_VSYNC_CHANNEL
+    sc->initVsyncFMQ(isServer);
+#endif
+#ifdef CONFIG_ENABLE_SHARED_BUFFER_STATE
+    sc->initBufferState(isServer);
+#endif
 }
 
-void uninitSurfaceBuffer(const std::shared_ptr<SurfaceControl>& sc) {
+void uninitSurfaceBuffer(const std::shared_ptr<SurfaceControl>& sc, bool isServer) {
     if (sc.get() == nullptr) return;
 
     FLOGI("try to uninit shared memory");
-    auto bufferIds = sc->bufferIds();
-    for (auto it : bufferIds) {
-        uninitSharedBuffer(it.mFd, it.mName);
+    /* buffers belong to server, which may hand the same names out again */
+    if (isServer) {
+        auto bufferIds = sc->bufferIds();
+        for (auto it : bufferIds) {
+            uninitSharedBuffer(it.mFd, it.mName);
+        }
     }
     sc->clearBufferIds();
     sc->destroyFMQ();
+    sc->destroyTransactionFMQ();
+    sc->destroyVsyncFMQ();
+    sc->destroyBufferState();
 }
 
 /**************** fmq ********************/
 template <typename T>
 FakeFmq<T>::FakeFmq()
-      : mName(""), mFd(0), mCaps(0), mReadPos(0), mWritePos(0), mQueue(NULL), mQueueSize(0) {}
+      : mName(""),
+        mFd(0),
+        mEventFd(-1),
+        mCaps(0),
+        mHeader(NULL),
+        mQueue(NULL),
+        mQueueSize(0) {}
 
 template <typename T>
 FakeFmq<T>::~FakeFmq() {
@@ -247,9 +336,13 @@ status_t FakeFmq<T>::writeToParcel(Parcel* out) const {
     SAFE_PARCEL(out->writeDupFileDescriptor, mFd);
 #endif
     SAFE_PARCEL(out->writeUint32, mCaps);
-    SAFE_PARCEL(out->writeUint32, mReadPos);
-    SAFE_PARCEL(out->writeUint32, mWritePos);
     SAFE_PARCEL(out->writeUint32, mQueueSize);
+#ifdef CONFIG_ENABLE_FMQ_EVENTFD
+    SAFE_PARCEL(out->writeBool, mEventFd >= 0);
+    if (mEventFd >= 0) {
+        SAFE_PARCEL(out->writeDupFileDescriptor, mEventFd);
+    }
+#endif
     return android::OK;
 }
 
@@ -263,9 +356,14 @@ status_t FakeFmq<T>::readFromParcel(const Parcel* in) {
     mFd = dup(in->readFileDescriptor());
 #endif
     SAFE_PARCEL(in->readUint32, &mCaps);
-    SAFE_PARCEL(in->readUint32, &mReadPos);
-    SAFE_PARCEL(in->readUint32, &mWritePos);
     SAFE_PARCEL(in->readUint32, &mQueueSize);
+#ifdef CONFIG_ENABLE_FMQ_EVENTFD
+    bool hasEventFd = false;
+    SAFE_PARCEL(in->readBool, &hasEventFd);
+    if (hasEventFd) {
+        mEventFd = dup(in->readFileDescriptor());
+    }
+#endif
     return android::OK;
 }
 
@@ -273,23 +371,28 @@ template <typename T>
 void FakeFmq<T>::copyFrom(FakeFmq<T>& other) {
     mName = other.mName;
     mFd = 0;
+    mEventFd = other.mEventFd >= 0 ? dup(other.mEventFd) : -1;
     mCaps = other.mCaps;
-    mReadPos = other.mReadPos;
-    mWritePos = other.mWritePos;
+    mHeader = NULL;
     mQueue = NULL;
     mQueueSize = other.mQueueSize;
 }
 
 template <typename T>
 void FakeFmq<T>::destroy() {
-    if (!mQueue) {
+    if (mEventFd >= 0) {
+        close(mEventFd);
+        mEventFd = -1;
+    }
+
+    if (!mHeader) {
         return;
     }
 
     FLOGI("now unmap and close shared memory for %d, %s", mFd, mName.c_str());
     uninitSharedBuffer(mFd, mName);
 
-    if (munmap(mQueue, mQueueSize) == -1) {
+    if (munmap(mHeader, mQueueSize) == -1) {
         FLOGE("failed to unmap shared memory fmq for %d", mFd);
     }
 
@@ -300,29 +403,45 @@ void FakeFmq<T>::destroy() {
     mFd = 0;
     mCaps = 0;
     mName = "";
-    mReadPos = 0;
-    mWritePos = 0;
+    mHeader = NULL;
     mQueue = NULL;
     mQueueSize = 0;
 }
 
 template <typename T>
-bool FakeFmq<T>::create(const std::vector<T>& qData, bool isServer) {
+bool FakeFmq<T>::create(const std::vector<T>& qData, bool isServer, uint32_t minCaps) {
     auto bufCount = qData.size();
 
-    if (bufCount <= 0 && mQueue == NULL) {
+    if (bufCount <= 0 && minCaps == 0 && mHeader == NULL) {
         FLOGW("cannot init empty fmq for %s", mName.c_str());
         return false;
     }
 
-    /* free previous dirty queue */
+    /* free previous dirty queue, the eventfd outlives it */
+    int eventFd = mEventFd;
+    mEventFd = -1;
     destroy();
 
-    uint32_t elmCount = qData.size() + 1;
-    auto size = elmCount * sizeof(T);
+#ifdef CONFIG_ENABLE_FMQ_EVENTFD
+    if (isServer && eventFd < 0) {
+        eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (eventFd < 0) {
+            FLOGW("failed to create eventfd for %s, %s", mName.c_str(), strerror(errno));
+        }
+    }
+#endif
+
+    /* room for the initial items and one more round of every item */
+    uint32_t caps = 1;
+    while (caps < bufCount * 2 || caps < minCaps) {
+        caps <<= 1;
+    }
+
+    auto size = sizeof(FmqHeader) + caps * sizeof(T);
     int fd = 0;
     if (!initSharedBuffer(mName, &fd, isServer ? size : 0)) {
         FLOGE("failed to init fmq for %s", mName.c_str());
+        if (eventFd >= 0) close(eventFd);
         return false;
     }
 
@@ -331,24 +450,185 @@ bool FakeFmq<T>::create(const std::vector<T>& qData, bool isServer) {
     if (buffer == MAP_FAILED) {
         FLOGE("failed to map fmq for %s", mName.c_str());
         uninitSharedBuffer(fd, mName);
+        if (eventFd >= 0) close(eventFd);
+        return false;
+    }
+
+    FmqHeader* header = (FmqHeader*)buffer;
+    T* queue = (T*)(header + 1);
+
+    /* only server resets the ring, client attaches to the live indices */
+    if (isServer) {
+        memset(buffer, 0, size);
+        header->mCaps = caps;
+
+        uint32_t i = 0;
+        for (const auto& value : qData) {
+            queue[i++] = value;
+        }
+        header->mHead.store(0, std::memory_order_relaxed);
+        header->mTail.store(i, std::memory_order_release);
+    } else if (header->mCaps != caps) {
+        FLOGE("fmq %s capacity mismatch, %" PRIu32 " vs %" PRIu32 "", mName.c_str(),
+              header->mCaps, caps);
+        munmap(buffer, size);
+        if (fd > 0) close(fd);
+        if (eventFd >= 0) close(eventFd);
         return false;
     }
 
     FLOGI("init fmq for %s", mName.c_str());
 
-    memset(buffer, 0, size);
-    mQueue = (T*)buffer;
+    mEventFd = eventFd;
+    mHeader = header;
+    mQueue = queue;
     mFd = fd;
+    mCaps = caps;
+    mQueueSize = size;
+    return true;
+}
 
-    int i = 0;
-    for (const auto& value : qData) {
-        mQueue[i++] = value;
+template <typename T>
+void FakeFmq<T>::armNotify() {
+    if (mHeader && mEventFd >= 0) {
+        mHeader->mWaiting.store(1, std::memory_order_seq_cst);
+        /* the caller loads mTail next, it must not move above the store */
+        std::atomic_thread_fence(std::memory_order_seq_cst);
     }
+}
 
-    mCaps = elmCount;
-    mReadPos = 0;
-    mWritePos = mCaps - 1;
-    mQueueSize = size;
+template <typename T>
+void FakeFmq<T>::notify() {
+    if (!mHeader || mEventFd < 0) {
+        return;
+    }
+
+    /* pairs with armNotify(), the reader checks the ring again after arming */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mHeader->mWaiting.exchange(0, std::memory_order_seq_cst)) {
+        uint64_t value = 1;
+        if (::write(mEventFd, &value, sizeof(value)) != (ssize_t)sizeof(value)) {
+            FLOGW("failed to notify fmq %s, %s", mName.c_str(), strerror(errno));
+        }
+    }
+}
+
+template <typename T>
+void FakeFmq<T>::clearNotify() {
+    if (mEventFd >= 0) {
+        uint64_t value;
+        ::read(mEventFd, &value, sizeof(value));
+    }
+}
+
+template class FakeFmq<BufferKey>;
+template class FakeFmq<LayerStateRecord>;
+template class FakeFmq<VsyncEvent>;
+
+/**************** buffer state ********************/
+BufferStateTable::BufferStateTable() : mName(""), mFd(-1), mHeader(NULL) {}
+
+BufferStateTable::~BufferStateTable() {
+    destroy();
+}
+
+status_t BufferStateTable::writeToParcel(Parcel* out) const {
+#ifdef CONFIG_ENABLE_BUFFER_QUEUE_BY_NAME
+    SAFE_PARCEL(out->writeCString, mName.c_str());
+#else
+    SAFE_PARCEL(out->writeDupFileDescriptor, mFd);
+#endif
+    return android::OK;
+}
+
+status_t BufferStateTable::readFromParcel(const Parcel* in) {
+#ifdef CONFIG_ENABLE_BUFFER_QUEUE_BY_NAME
+    mName = in->readCString();
+    mFd = -1;
+#else
+    mName = "";
+    mFd = dup(in->readFileDescriptor());
+#endif
+    return android::OK;
+}
+
+void BufferStateTable::copyFrom(BufferStateTable& other) {
+    destroy();
+    mName = other.mName;
+    mFd = other.mFd > 0 ? dup(other.mFd) : -1;
+    mHeader = NULL;
+}
+
+void BufferStateTable::destroy() {
+    if (mHeader) {
+        FLOGI("now unmap and close buffer state for %d, %s", mFd, mName.c_str());
+        uninitSharedBuffer(mFd, mName);
+
+        if (munmap(mHeader, sizeof(BufferStateHeader)) == -1) {
+            FLOGE("failed to unmap buffer state for %d", mFd);
+        }
+        mHeader = NULL;
+    }
+
+    if (mFd > 0 && close(mFd) == -1) {
+        FLOGE("failed to close buffer state for %d", mFd);
+    }
+
+    mFd = -1;
+    mName = "";
+}
+
+bool BufferStateTable::create(const std::vector<BufferKey>& keys, bool isServer) {
+    if (keys.empty() || keys.size() > BUFFER_QUEUE_MAX_SLOTS) {
+        FLOGW("cannot init buffer state for %zu buffers", keys.size());
+        return false;
+    }
+
+    if (mHeader) {
+        munmap(mHeader, sizeof(BufferStateHeader));
+        mHeader = NULL;
+    }
+
+    auto size = sizeof(BufferStateHeader);
+    int fd = mFd;
+
+    /* client may have received the descriptor from parcel */
+    if (isServer || fd <= 0) {
+        if (fd > 0) close(fd);
+        mFd = -1;
+        if (!initSharedBuffer(mName, &fd, isServer ? size : 0)) {
+            FLOGE("failed to init buffer state for %s", mName.c_str());
+            return false;
+        }
+    }
+
+    void* buffer = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (buffer == MAP_FAILED) {
+        FLOGE("failed to map buffer state for %s", mName.c_str());
+        if (isServer) uninitSharedBuffer(fd, mName);
+        close(fd);
+        mFd = -1;
+        return false;
+    }
+
+    mFd = fd;
+    mHeader = (BufferStateHeader*)buffer;
+
+    if (isServer) {
+        mHeader->mCount = keys.size();
+        for (uint32_t i = 0; i < keys.size(); i++) {
+            mHeader->mKeys[i] = keys[i];
+            mHeader->mStates[i].store(BSTATE_FREE, std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+    } else if (mHeader->mCount != keys.size()) {
+        FLOGE("buffer state for %s holds %" PRIu32 " buffers, expect %zu", mName.c_str(),
+              mHeader->mCount, keys.size());
+        destroy();
+        return false;
+    }
+
+    FLOGI("init buffer state for %s", mName.c_str());
     return true;
 }
 
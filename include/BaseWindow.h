@@ -30,6 +30,7 @@
 #include "wm/InputMessage.h"
 #include "wm/InputMonitor.h"
 #include "wm/LayoutParams.h"
+#include "wm/VsyncEvent.h"
 #include "wm/WindowEventListener.h"
 #include "wm/WindowFrames.h"
 namespace os {
@@ -46,6 +47,7 @@ using MOCKUI_EVENT_CALLBACK = std::function<void(void*, uint32_t, uint32_t)>;
 // end for MockUI (DummyDriver)
 
 class BufferProducer;
+class FmqMonitor;
 class UIDriverProxy;
 class WindowManager;
 class InputChannel;
@@ -63,7 +65,8 @@ public:
         Status moved(int32_t newX, int32_t newY) override;
         Status resized(const WindowFrames& frames, int32_t displayId) override;
         Status dispatchAppVisibility(bool visible) override;
-        Status onFrame(int32_t seq) override;
+        Status onFrame(int32_t seq, int64_t vsyncTime, int64_t deadline,
+                       int64_t presentTime) override;
         Status bufferReleased(int32_t bufKey) override;
 
         void clear();
@@ -76,6 +79,8 @@ public:
     ~BaseWindow();
 
     bool scheduleVsync(VsyncRequest freq);
+    /* periodic frames arrive every divisor refreshes, 1 is the panel rate */
+    void setVsyncRateDivisor(uint32_t divisor);
 
     sp<IWindow> getIWindow() {
         return mIWindow;
@@ -117,9 +122,17 @@ public:
 
     void traceFrame(bool enable);
 
+    /* frames skipped for lack of buffer while the server had already released one */
+    uint32_t getPendingReleaseSkips() const {
+        return mPendingReleaseSkips;
+    }
+
 private:
-    void onFrame(int32_t seq);
+    void onFrame(const VsyncEvent& event);
     void bufferReleased(int32_t bufKey);
+    void drainReleasedBuffers();
+    void onBuffersReleased();
+    void onVsyncEvents();
 
     std::shared_ptr<BufferProducer> getBufferProducer();
     void updateOrCreateBufferQueue();
@@ -133,6 +146,8 @@ private:
     sp<W> mIWindow;
     std::shared_ptr<SurfaceControl> mSurfaceControl;
     std::shared_ptr<InputMonitor> mInputMonitor;
+    std::shared_ptr<FmqMonitor> mReleaseMonitor;
+    std::shared_ptr<FmqMonitor> mVsyncMonitor;
     std::shared_ptr<UIDriverProxy> mUIProxy;
     VsyncRequest mVsyncRequest;
     bool mAppVisible;
@@ -140,6 +155,10 @@ private:
     bool mSurfaceBufferReady;
     bool mTraceFrame;
     void* mFrameTimeInfo;
+    uint32_t mPendingReleaseSkips;
+    bool mFrameSuppressed;
+    int32_t mSuppressedSeq;
+    uint32_t mVsyncRateDivisor;
 };
 
 } // namespace wm
@@ -17,15 +17,18 @@
 #pragma once
 #include <nuttx/config.h>
 
-#include <list>
 #include <memory>
 #include <string>
-#include <unordered_map>
+
+#include "wm/Rect.h"
 
 namespace os {
 namespace wm {
 
+#define BUFFER_QUEUE_MAX_SLOTS 4
+
 class SurfaceControl;
+class BufferStateTable;
 
 typedef enum {
     BSTATE_FREE = 0,
@@ -48,6 +51,10 @@ typedef struct {
     uint32_t mSize;
     BufferState mState;
     void* mUserData;
+    // frames since the content was queued, 0 means the content is undefined
+    uint32_t mAge;
+    // area changed by the frames queued after this buffer, valid when age > 1
+    Rect mDamage;
 } BufferItem;
 
 typedef enum {
@@ -55,6 +62,14 @@ typedef enum {
     BSLOT_DATA,
 } BufferSlot;
 
+// FIFO of buffer indices, mMask mirrors the membership for constant-time lookup
+typedef struct {
+    uint8_t mIndex[BUFFER_QUEUE_MAX_SLOTS];
+    uint8_t mHead;
+    uint8_t mCount;
+    uint32_t mMask;
+} BufferRing;
+
 class BufferQueue {
 public:
     BufferQueue(const std::shared_ptr<SurfaceControl>& sc);
@@ -63,20 +78,41 @@ public:
     bool update(const std::shared_ptr<SurfaceControl>& sc);
     bool cancelBuffer(BufferItem* item);
 
+    bool hasSharedState() const {
+        return mStateTable != nullptr;
+    }
+
+    /* buffers this side sees as free */
+    uint32_t freeCount() const {
+        return mFreeSlot.mCount;
+    }
+
 protected:
     BufferItem* getBuffer(BufferSlot slot);
     BufferItem* syncState(BufferKey key, BufferState state);
-    bool toState(BufferItem* item, BufferState state);
+    void syncSharedState();
+    uint32_t sharedReleasedCount() const;
+    bool toState(BufferItem* item, BufferState state, bool publish = true);
+    void updateBufferAge(BufferItem* queued, const Rect* damage);
+
+    std::shared_ptr<SurfaceControl> getSurfaceControl() const {
+        return mSurfaceControl.lock();
+    }
 
 private:
     BufferItem* getBuffer(BufferKey bufKey);
+    int32_t indexOf(const BufferItem* item) const;
     void clearBuffers();
 
     std::weak_ptr<SurfaceControl> mSurfaceControl;
-    std::unordered_map<BufferKey, BufferItem> mBuffers;
+    BufferItem mBuffers[BUFFER_QUEUE_MAX_SLOTS];
+    uint32_t mBufferCount;
+
+    BufferRing mDataSlot;
+    BufferRing mFreeSlot;
 
-    std::list<BufferKey> mDataSlot;
-    std::list<BufferKey> mFreeSlot;
+    // shared with the other side, null when states are synced by messages
+    std::shared_ptr<BufferStateTable> mStateTable;
 
     uint32_t mWidth;
     uint32_t mHeight;
@@ -89,7 +125,10 @@ public:
     ~BufferProducer();
 
     BufferItem* dequeueBuffer();
-    bool queueBuffer(BufferItem* buffer);
+    bool queueBuffer(BufferItem* buffer, const Rect* damage = nullptr);
+
+    /* buffers released by the consumer that dequeueBuffer() has not picked up */
+    uint32_t pendingReleases();
 
     BufferItem* syncFreeState(BufferKey key) {
         return syncState(key, BSTATE_FREE);
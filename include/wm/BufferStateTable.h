@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <binder/Parcel.h>
+#include <binder/Status.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "wm/BufferQueue.h"
+
+namespace os {
+namespace wm {
+
+using android::Parcel;
+using android::status_t;
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "buffer state words must be lock free");
+
+/*
+ * Shared memory header holding the state word of every buffer of a surface,
+ * indexed the same way as the BufferQueue slots on both sides.
+ */
+typedef struct {
+    uint32_t mCount;
+    BufferKey mKeys[BUFFER_QUEUE_MAX_SLOTS];
+    std::atomic<int32_t> mStates[BUFFER_QUEUE_MAX_SLOTS];
+} BufferStateHeader;
+
+class BufferStateTable {
+public:
+    BufferStateTable();
+    ~BufferStateTable();
+
+    bool create(const std::vector<BufferKey>& keys, bool isServer);
+    void destroy();
+
+    bool isValid() const {
+        return mHeader != nullptr;
+    }
+
+    uint32_t count() const {
+        return mHeader ? mHeader->mCount : 0;
+    }
+
+    BufferKey keyAt(uint32_t index) const {
+        return mHeader->mKeys[index];
+    }
+
+    BufferState load(uint32_t index) const {
+        return (BufferState)mHeader->mStates[index].load(std::memory_order_acquire);
+    }
+
+    bool compareAndSet(uint32_t index, BufferState from, BufferState to) {
+        int32_t expected = from;
+        return mHeader->mStates[index].compare_exchange_strong(expected, to,
+                                                               std::memory_order_acq_rel,
+                                                               std::memory_order_acquire);
+    }
+
+    void setName(const std::string& name) {
+        mName = name;
+    }
+    std::string getName() {
+        return mName;
+    }
+
+    status_t writeToParcel(Parcel* out) const;
+    status_t readFromParcel(const Parcel* in);
+    void copyFrom(BufferStateTable& other);
+
+private:
+    std::string mName;
+    int mFd;
+    BufferStateHeader* mHeader;
+};
+
+} // namespace wm
+} // namespace os
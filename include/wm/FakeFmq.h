@@ -23,6 +23,11 @@
 #include <binder/Status.h>
 #include <utils/RefBase.h>
 
+#include <atomic>
+#include <string>
+#include <type_traits>
+#include <vector>
+
 namespace os {
 namespace wm {
 
@@ -32,44 +37,105 @@ using android::Parcelable;
 using android::sp;
 using android::status_t;
 
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "fmq indices must be lock free");
+
+/*
+ * Shared memory header of the ring, the elements follow it. Both indices run
+ * freely and are masked by the power of two capacity, so head == tail means
+ * empty and tail - head == caps means full. The other side may write any
+ * value, so readers treat tail - head > caps as an empty ring.
+ */
+typedef struct {
+    std::atomic<uint32_t> mHead; /* next slot to read, only moved by the reader */
+    std::atomic<uint32_t> mTail; /* next slot to write, only moved by the writer */
+    uint32_t mCaps;
+    std::atomic<uint32_t> mWaiting; /* reader asked for a wakeup on the next write */
+} FmqHeader;
+
+/* single producer single consumer ring on shared memory */
 template <typename T>
 class FakeFmq {
+    static_assert(std::is_trivially_copyable<T>::value, "fmq element must be trivially copyable");
+
 public:
     FakeFmq();
     ~FakeFmq();
 
     bool read(T* data) {
-        if (!mQueue || mCaps <= 0 || !data) {
+        if (!mHeader || !data) {
             return false;
         }
 
-        auto current = mQueue[mReadPos];
-
-        /* no valid item */
-        if (current == 0) {
+        uint32_t head = mHeader->mHead.load(std::memory_order_relaxed);
+        uint32_t tail = mHeader->mTail.load(std::memory_order_acquire);
+        if (pending(head, tail) == 0) {
             return false;
         }
 
-        *data = current;
-        mReadPos = (mReadPos + 1) % mCaps;
+        *data = mQueue[head & (mCaps - 1)];
+        mHeader->mHead.store(head + 1, std::memory_order_release);
         return true;
     }
 
+    /* read up to count pending items at once, returns how many were read */
+    uint32_t readAll(T* data, uint32_t count) {
+        if (!mHeader || !data) {
+            return 0;
+        }
+
+        uint32_t head = mHeader->mHead.load(std::memory_order_relaxed);
+        uint32_t tail = mHeader->mTail.load(std::memory_order_acquire);
+        uint32_t avail = pending(head, tail);
+        if (avail > count) avail = count;
+
+        for (uint32_t i = 0; i < avail; i++) {
+            data[i] = mQueue[(head + i) & (mCaps - 1)];
+        }
+
+        if (avail > 0) {
+            mHeader->mHead.store(head + avail, std::memory_order_release);
+        }
+        return avail;
+    }
+
     bool write(const T* data) {
-        if (!mQueue || mCaps <= 0 || !data) {
+        if (!mHeader || !data) {
             return false;
         }
 
-        /*firstly write ending flag */
-        auto next = (mWritePos + 1) % mCaps;
-        mQueue[next] = 0;
+        uint32_t tail = mHeader->mTail.load(std::memory_order_relaxed);
+        uint32_t head = mHeader->mHead.load(std::memory_order_acquire);
+        if (tail - head >= mCaps) {
+            return false;
+        }
 
-        mQueue[mWritePos] = *data;
-        mWritePos = next;
+        mQueue[tail & (mCaps - 1)] = *data;
+        mHeader->mTail.store(tail + 1, std::memory_order_release);
         return true;
     }
 
-    bool create(const std::vector<T>& qData, bool isServer);
+    uint32_t size() const {
+        if (!mHeader) return 0;
+        return pending(mHeader->mHead.load(std::memory_order_relaxed),
+                       mHeader->mTail.load(std::memory_order_acquire));
+    }
+
+    uint32_t capacity() const {
+        return mCaps;
+    }
+
+    int getEventFd() const {
+        return mEventFd;
+    }
+
+    /* reader side: ask the writer to signal the eventfd on the next notify */
+    void armNotify();
+    /* writer side: signal the eventfd if the reader is waiting */
+    void notify();
+    /* reader side: consume the pending signal */
+    void clearNotify();
+
+    bool create(const std::vector<T>& qData, bool isServer, uint32_t minCaps = 0);
     void destroy();
 
     void setName(const std::string& name) {
@@ -84,12 +150,16 @@ public:
     void copyFrom(FakeFmq<T>& other);
 
 private:
+    uint32_t pending(uint32_t head, uint32_t tail) const {
+        uint32_t count = tail - head;
+        return count <= mCaps ? count : 0;
+    }
+
     std::string mName;
     int mFd;
+    int mEventFd;
     uint32_t mCaps;
-    uint32_t mReadPos;
-    uint32_t mWritePos;
-    uint32_t mReserved;
+    FmqHeader* mHeader;
     T* mQueue;
     uint32_t mQueueSize;
 };
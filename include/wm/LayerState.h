@@ -32,20 +32,40 @@ using android::Parcelable;
 using android::sp;
 using android::status_t;
 
+// damaged rects carried with a buffer, more are merged into their bounds
+#define LAYER_STATE_MAX_DAMAGE 4
+
+/* fixed size layer state, carried by the transaction channel of a surface */
+typedef struct {
+    int32_t mFlags;
+    uint32_t mSeq;
+    int32_t mX;
+    int32_t mY;
+    int32_t mAlpha;
+    BufferKey mBufferKey;
+    BaseRect mBufferCrop;
+    uint32_t mDamageCount;
+    BaseRect mDamage[LAYER_STATE_MAX_DAMAGE];
+} LayerStateRecord;
+
 class LayerState : public Parcelable {
 public:
-    LayerState() : mFlags(0), mToken(nullptr), mSeq(0) {}
+    LayerState() : mDamageCount(0), mFlags(0), mToken(nullptr), mSeq(0) {}
     ~LayerState() {
         mToken = nullptr;
         mFlags = 0;
     }
 
-    LayerState(sp<IBinder> token) : mFlags(0), mToken(token) {}
+    LayerState(sp<IBinder> token) : mDamageCount(0), mFlags(0), mToken(token), mSeq(0) {}
 
     status_t writeToParcel(Parcel* out) const override;
     status_t readFromParcel(const Parcel* in) override;
 
     void merge(LayerState& state);
+    void setDamage(const Rect* rects, uint32_t count);
+
+    void toRecord(LayerStateRecord* record) const;
+    void fromRecord(const LayerStateRecord& record);
 
     enum {
         LAYER_POSITION_CHANGED = 0x01,
@@ -58,7 +78,10 @@ public:
     int32_t mY;
     int32_t mAlpha;
     BufferKey mBufferKey;
+    // bounds of mDamage
     Rect mBufferCrop;
+    Rect mDamage[LAYER_STATE_MAX_DAMAGE];
+    uint32_t mDamageCount;
     int32_t mFlags;
     sp<IBinder> mToken;
     uint32_t mSeq;
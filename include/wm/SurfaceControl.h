@@ -26,7 +26,10 @@
 #include <unordered_map>
 
 #include "wm/BufferQueue.h"
+#include "wm/BufferStateTable.h"
 #include "wm/FakeFmq.h"
+#include "wm/LayerState.h"
+#include "wm/VsyncEvent.h"
 
 namespace os {
 namespace wm {
@@ -38,6 +41,13 @@ using android::sp;
 using android::status_t;
 
 typedef FakeFmq<BufferKey> SurfaceFreeInfoClass;
+typedef FakeFmq<LayerStateRecord> SurfaceTransactionClass;
+typedef FakeFmq<VsyncEvent> SurfaceVsyncClass;
+
+/* layer states the transaction channel holds before falling back to binder */
+#define SURFACE_TRANSACTION_CAPS 8
+/* vsync events the channel holds while the window is busy */
+#define SURFACE_VSYNC_CAPS 4
 
 class SurfaceControl : public Parcelable {
 public:
@@ -105,6 +115,27 @@ public:
         return mFreeMsgSlot;
     }
 
+    bool initTransactionFMQ(bool isServer);
+    void destroyTransactionFMQ();
+
+    SurfaceTransactionClass& getTransactionFMQ() {
+        return mTransactionSlot;
+    }
+
+    bool initVsyncFMQ(bool isServer);
+    void destroyVsyncFMQ();
+
+    SurfaceVsyncClass& getVsyncFMQ() {
+        return mVsyncSlot;
+    }
+
+    bool initBufferState(bool isServer);
+    void destroyBufferState();
+
+    std::shared_ptr<BufferStateTable> getBufferState() {
+        return mBufferState;
+    }
+
 private:
     DISALLOW_COPY_AND_ASSIGN(SurfaceControl);
 
@@ -122,10 +153,13 @@ private:
     std::vector<BufferId> mBufferIds;
     std::shared_ptr<BufferQueue> mBufferQueue;
     SurfaceFreeInfoClass mFreeMsgSlot;
+    SurfaceTransactionClass mTransactionSlot;
+    SurfaceVsyncClass mVsyncSlot;
+    std::shared_ptr<BufferStateTable> mBufferState;
 };
 
 void initSurfaceBuffer(const std::shared_ptr<SurfaceControl>& sc, bool isServer);
-void uninitSurfaceBuffer(const std::shared_ptr<SurfaceControl>& sc);
+void uninitSurfaceBuffer(const std::shared_ptr<SurfaceControl>& sc, bool isServer);
 
 } // namespace wm
 } // namespace os
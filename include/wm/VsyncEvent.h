@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace os {
+namespace wm {
+
+/* frame request delivered through the vsync channel of a surface */
+typedef struct {
+    uint32_t mSeq;
+    // refresh period in milliseconds
+    uint32_t mPeriod;
+    // CLOCK_MONOTONIC time of the vsync in microseconds
+    uint64_t mTimestamp;
+    // latest time a buffer can be queued and still be latched for mPresentTime
+    uint64_t mDeadline;
+    // expected time the frame reaches the panel
+    uint64_t mPresentTime;
+} VsyncEvent;
+
+} // namespace wm
+} // namespace os
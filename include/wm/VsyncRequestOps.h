@@ -33,7 +33,10 @@ static inline VsyncRequest nextVsyncState(VsyncRequest req) {
             return VsyncRequest::VSYNC_REQ_SINGLE;
 
         case VsyncRequest::VSYNC_REQ_PERIODIC:
-            return VsyncRequest::VSYNC_REQ_PERIODIC;
+        case VsyncRequest::VSYNC_REQ_PERIODIC_DIV2:
+        case VsyncRequest::VSYNC_REQ_PERIODIC_DIV3:
+        case VsyncRequest::VSYNC_REQ_PERIODIC_DIV4:
+            return req;
 
         default:
             break;
@@ -42,6 +45,22 @@ static inline VsyncRequest nextVsyncState(VsyncRequest req) {
     return VsyncRequest::VSYNC_REQ_NONE;
 }
 
+static inline bool isPeriodicVsync(VsyncRequest req) {
+    return req >= VsyncRequest::VSYNC_REQ_PERIODIC;
+}
+
+/* deliver a frame every N refreshes */
+static inline uint32_t vsyncRateDivisor(VsyncRequest req) {
+    return isPeriodicVsync(req) ? (uint32_t)req : 1;
+}
+
+static inline VsyncRequest periodicVsyncRequest(uint32_t divisor) {
+    if (divisor <= 1) return VsyncRequest::VSYNC_REQ_PERIODIC;
+    if (divisor >= (uint32_t)VsyncRequest::VSYNC_REQ_PERIODIC_DIV4)
+        return VsyncRequest::VSYNC_REQ_PERIODIC_DIV4;
+    return (VsyncRequest)divisor;
+}
+
 static inline const char* VsyncRequestToString(VsyncRequest req) {
     switch (req) {
         case VsyncRequest::VSYNC_REQ_NONE:
@@ -56,6 +75,15 @@ static inline const char* VsyncRequestToString(VsyncRequest req) {
         case VsyncRequest::VSYNC_REQ_PERIODIC:
             return "periodic";
 
+        case VsyncRequest::VSYNC_REQ_PERIODIC_DIV2:
+            return "periodic/2";
+
+        case VsyncRequest::VSYNC_REQ_PERIODIC_DIV3:
+            return "periodic/3";
+
+        case VsyncRequest::VSYNC_REQ_PERIODIC_DIV4:
+            return "periodic/4";
+
         default:
             break;
     }
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "WMS:CompCache"
+
+#include "CompositionCache.h"
+
+#include <inttypes.h>
+#include <lvgl/src/lvgl_private.h>
+#include <string.h>
+
+#include "../common/WindowUtils.h"
+#include "lvgl/lv_mainwnd.h"
+
+namespace os {
+namespace wm {
+
+CompositionCache::CompositionCache(lv_display_t* disp, lv_obj_t* layer)
+      : mDisp(disp),
+        mLayer(layer),
+        mObj(nullptr),
+        mBuffer(nullptr),
+        mDirtyCount(0),
+        mAllDirty(true),
+        mDropCount(0),
+        mRendering(false),
+        mRenderedDirtyCount(0),
+        mRenderedDropCount(0),
+        mCovering(false) {
+    /* transparent and input free, it only stands above the windows */
+    mObj = lv_obj_create(mLayer);
+    lv_obj_remove_style_all(mObj);
+    lv_obj_clear_flag(mObj, LV_OBJ_FLAG_CLICKABLE);
+    lv_obj_clear_flag(mObj, LV_OBJ_FLAG_SCROLLABLE);
+    lv_obj_set_pos(mObj, 0, 0);
+    lv_obj_set_size(mObj, lv_display_get_horizontal_resolution(mDisp),
+                    lv_display_get_vertical_resolution(mDisp));
+
+    /* the copy must hold the windows even where a toast hides them now */
+    lv_obj_add_flag(mLayer, LV_MAINWND_LAYER_FLAG_NO_UPPER_CULL);
+
+    lv_obj_add_event_cb(mObj, cacheEventCallback, LV_EVENT_ALL, this);
+    lv_obj_add_event_cb(mLayer, layerEventCallback, LV_EVENT_ALL, this);
+    drop();
+}
+
+CompositionCache::~CompositionCache() {
+    lv_obj_remove_event_cb_with_user_data(mLayer, layerEventCallback, this);
+    lv_obj_clear_flag(mLayer, LV_MAINWND_LAYER_FLAG_NO_UPPER_CULL);
+    lv_obj_del(mObj);
+    if (mBuffer) lv_draw_buf_destroy(mBuffer);
+}
+
+void CompositionCache::onRenderStart() {
+    mRendering = true;
+    mRenderedDirtyCount = mDirtyCount;
+    mRenderedDropCount = mDropCount;
+}
+
+void CompositionCache::onRenderFinished() {
+    if (!mRendering) return;
+    mRendering = false;
+
+    /* LVGL ignores invalidation while rendering, ask again for what came late */
+    if (mDropCount != mRenderedDropCount) {
+        lv_obj_invalidate(mLayer);
+        return;
+    }
+
+    mAllDirty = false;
+    uint32_t late = mDirtyCount - mRenderedDirtyCount;
+    for (uint32_t i = 0; i < late; i++) {
+        mDirty[i] = mDirty[mRenderedDirtyCount + i];
+        lv_obj_invalidate_area(mLayer, &mDirty[i]);
+    }
+    mDirtyCount = late;
+}
+
+void CompositionCache::drop() {
+    mAllDirty = true;
+    mDirtyCount = 0;
+    mDropCount++;
+    lv_obj_invalidate(mLayer);
+}
+
+void CompositionCache::addDirtyArea(const lv_area_t* area) {
+    if (mAllDirty && !mRendering) return;
+
+    if (mDirtyCount == MAX_DIRTY_AREAS) {
+        drop();
+        return;
+    }
+    mDirty[mDirtyCount++] = *area;
+}
+
+bool CompositionCache::isValid(const lv_area_t* area) {
+    if (mAllDirty || !mBuffer) return false;
+
+    lv_area_t common;
+    for (uint32_t i = 0; i < mDirtyCount; i++) {
+        if (_lv_area_intersect(&common, &mDirty[i], area)) return false;
+    }
+    return true;
+}
+
+bool CompositionCache::prepareBuffer(lv_layer_t* layer) {
+    /* only the display layer holds the composed screen */
+    if (layer->parent || !layer->draw_buf) return false;
+
+    if (mBuffer && mBuffer->header.cf == layer->color_format) return true;
+
+    if (mBuffer) lv_draw_buf_destroy(mBuffer);
+    mBuffer = lv_draw_buf_create(lv_display_get_horizontal_resolution(mDisp),
+                                 lv_display_get_vertical_resolution(mDisp), layer->color_format,
+                                 LV_STRIDE_AUTO);
+    if (!mBuffer) {
+        FLOGE("no memory for the composition cache");
+        return false;
+    }
+    FLOGI("cache %" PRIu32 "x%" PRIu32 " cf=%d", mBuffer->header.w, mBuffer->header.h,
+          layer->color_format);
+
+    /* nothing captured yet */
+    drop();
+    return false;
+}
+
+void CompositionCache::copyLayer(lv_layer_t* layer, bool capture) {
+    lv_area_t area;
+    lv_area_t cacheArea = {0, 0, (int32_t)mBuffer->header.w - 1, (int32_t)mBuffer->header.h - 1};
+    if (!_lv_area_intersect(&area, &layer->_clip_area, &layer->buf_area) ||
+        !_lv_area_intersect(&area, &area, &cacheArea)) {
+        return;
+    }
+
+    /* the windows below must have landed before they are read back */
+    while (layer->draw_task_head) {
+        lv_draw_dispatch_wait_for_request();
+        lv_draw_dispatch();
+    }
+
+    WM_PROFILER_BEGIN();
+    uint32_t pixelSize = lv_color_format_get_size(layer->color_format);
+    uint32_t layerStride = layer->draw_buf->header.stride;
+    uint32_t cacheStride = mBuffer->header.stride;
+    uint32_t size = lv_area_get_width(&area) * pixelSize;
+    uint8_t* layerData = layer->draw_buf->data + (area.y1 - layer->buf_area.y1) * layerStride +
+            (area.x1 - layer->buf_area.x1) * pixelSize;
+    uint8_t* cacheData = mBuffer->data + area.y1 * cacheStride + area.x1 * pixelSize;
+
+    for (int32_t y = area.y1; y <= area.y2; y++) {
+        if (capture) {
+            memcpy(cacheData, layerData, size);
+        } else {
+            memcpy(layerData, cacheData, size);
+        }
+        layerData += layerStride;
+        cacheData += cacheStride;
+    }
+    WM_PROFILER_END();
+}
+
+void CompositionCache::layerEventCallback(lv_event_t* e) {
+    CompositionCache* cache = (CompositionCache*)lv_event_get_user_data(e);
+    lv_event_code_t code = lv_event_get_code(e);
+
+    if (code == lv_mainwnd_get_damage_event()) {
+        const lv_area_t* area = (const lv_area_t*)lv_event_get_param(e);
+        if (area) {
+            cache->addDirtyArea(area);
+        } else {
+            cache->drop();
+        }
+        return;
+    }
+
+    switch (code) {
+        case LV_EVENT_CHILD_CREATED: {
+            /* keep standing above every window */
+            lv_obj_move_foreground(cache->mObj);
+            cache->drop();
+            break;
+        }
+        case LV_EVENT_CHILD_CHANGED: {
+            /* a window moved, resized or changed visibility */
+            if (lv_event_get_param(e) != cache->mObj) cache->drop();
+            break;
+        }
+        case LV_EVENT_CHILD_DELETED:
+        case LV_EVENT_STYLE_CHANGED: {
+            cache->drop();
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void CompositionCache::cacheEventCallback(lv_event_t* e) {
+    CompositionCache* cache = (CompositionCache*)lv_event_get_user_data(e);
+
+    switch (lv_event_get_code(e)) {
+        case LV_EVENT_COVER_CHECK: {
+            /* runs after the class handler, which found the object transparent */
+            lv_cover_check_info_t* info = (lv_cover_check_info_t*)lv_event_get_param(e);
+            cache->mCovering = info->res != LV_COVER_RES_MASKED && cache->isValid(info->area);
+            if (cache->mCovering) info->res = LV_COVER_RES_COVER;
+            break;
+        }
+        case LV_EVENT_DRAW_MAIN: {
+            lv_layer_t* layer = lv_event_get_layer(e);
+            if (cache->prepareBuffer(layer)) {
+                cache->copyLayer(layer, !cache->mCovering);
+            }
+            cache->mCovering = false;
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+} // namespace wm
+} // namespace os
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/macros.h>
+#include <lvgl/lvgl.h>
+
+namespace os {
+namespace wm {
+
+/*
+ * Keeps the composed default layer in an offscreen buffer. A full screen
+ * object above the application windows tells LVGL it covers every area where
+ * none of them changed, so LVGL starts drawing from it: the copy is restored
+ * and only the top and system layers are composed over it. Areas the windows
+ * damaged are composed as usual and captured again when LVGL reaches the
+ * object.
+ */
+class CompositionCache {
+public:
+    CompositionCache(lv_display_t* disp, lv_obj_t* layer);
+    ~CompositionCache();
+
+    void onRenderStart();
+    void onRenderFinished();
+    /* forget the copy and recompose the whole layer */
+    void drop();
+
+    lv_obj_t* getObject() {
+        return mObj;
+    }
+
+    DISALLOW_COPY_AND_ASSIGN(CompositionCache);
+
+private:
+    static constexpr uint32_t MAX_DIRTY_AREAS = 8;
+
+    static void layerEventCallback(lv_event_t* e);
+    static void cacheEventCallback(lv_event_t* e);
+
+    void addDirtyArea(const lv_area_t* area);
+    bool isValid(const lv_area_t* area);
+    bool prepareBuffer(lv_layer_t* layer);
+    void copyLayer(lv_layer_t* layer, bool capture);
+
+    lv_display_t* mDisp;
+    lv_obj_t* mLayer;
+    lv_obj_t* mObj;
+    lv_draw_buf_t* mBuffer;
+
+    /* damaged since the last capture */
+    lv_area_t mDirty[MAX_DIRTY_AREAS];
+    uint32_t mDirtyCount;
+    bool mAllDirty;
+    uint32_t mDropCount;
+
+    /* what the refresh in progress captures */
+    bool mRendering;
+    uint32_t mRenderedDirtyCount;
+    uint32_t mRenderedDropCount;
+    bool mCovering;
+};
+
+} // namespace wm
+} // namespace os
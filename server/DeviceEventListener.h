@@ -24,6 +24,7 @@ namespace wm {
 class DeviceEventListener {
 public:
     virtual bool responseVsync() = 0;
+    virtual bool responseFrameStart() = 0;
     virtual bool responseInput(InputMessage* msg) = 0;
 };
 
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DirtyTileMap.h"
+
+#include <algorithm>
+
+namespace os {
+namespace wm {
+
+DirtyTileMap::DirtyTileMap(int32_t tileSize)
+      : mTileSize(tileSize > 0 ? tileSize : 32),
+        mWidth(0),
+        mHeight(0),
+        mColumns(0),
+        mRows(0),
+        mDirtyCount(0) {}
+
+void DirtyTileMap::resize(int32_t width, int32_t height) {
+    mWidth = std::max(width, 0);
+    mHeight = std::max(height, 0);
+    mColumns = (mWidth + mTileSize - 1) / mTileSize;
+    mRows = (mHeight + mTileSize - 1) / mTileSize;
+    mTiles.assign(mColumns * mRows, 0);
+    mDirtyCount = 0;
+}
+
+void DirtyTileMap::mark(const TileArea& area) {
+    int32_t x1 = std::max(area.x1, 0);
+    int32_t y1 = std::max(area.y1, 0);
+    int32_t x2 = std::min(area.x2, mWidth - 1);
+    int32_t y2 = std::min(area.y2, mHeight - 1);
+    if (x1 > x2 || y1 > y2) return;
+
+    for (int32_t row = y1 / mTileSize; row <= y2 / mTileSize; row++) {
+        uint8_t* tile = &mTiles[row * mColumns];
+        for (int32_t col = x1 / mTileSize; col <= x2 / mTileSize; col++) {
+            if (!tile[col]) {
+                tile[col] = 1;
+                mDirtyCount++;
+            }
+        }
+    }
+}
+
+void DirtyTileMap::clear() {
+    if (mDirtyCount == 0) return;
+    std::fill(mTiles.begin(), mTiles.end(), 0);
+    mDirtyCount = 0;
+}
+
+uint32_t DirtyTileMap::collect(TileArea* areas, uint32_t maxCount) const {
+    if (mDirtyCount == 0 || maxCount == 0) return 0;
+
+    /* rectangles reaching the previous row, in column order, in tile units */
+    std::vector<uint32_t> open;
+    std::vector<uint32_t> next;
+    uint32_t count = 0;
+
+    for (int32_t row = 0; row < mRows; row++) {
+        const uint8_t* tile = &mTiles[row * mColumns];
+        size_t index = 0;
+        next.clear();
+
+        for (int32_t col = 0; col < mColumns;) {
+            if (!tile[col]) {
+                col++;
+                continue;
+            }
+            int32_t first = col;
+            while (col < mColumns && tile[col]) col++;
+            int32_t last = col - 1;
+
+            /* the same run as on the row above grows that rectangle */
+            while (index < open.size() && areas[open[index]].x2 < first) index++;
+            if (index < open.size() && areas[open[index]].x1 == first &&
+                areas[open[index]].x2 == last) {
+                areas[open[index]].y2 = row;
+                next.push_back(open[index++]);
+                continue;
+            }
+
+            if (count == maxCount) return 0;
+            areas[count] = {first, row, last, row};
+            next.push_back(count++);
+        }
+        open.swap(next);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        areas[i].x1 = areas[i].x1 * mTileSize;
+        areas[i].y1 = areas[i].y1 * mTileSize;
+        areas[i].x2 = std::min((areas[i].x2 + 1) * mTileSize, mWidth) - 1;
+        areas[i].y2 = std::min((areas[i].y2 + 1) * mTileSize, mHeight) - 1;
+    }
+    return count;
+}
+
+} // namespace wm
+} // namespace os
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/macros.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace os {
+namespace wm {
+
+/* inclusive pixel area, laid out like lv_area_t */
+typedef struct {
+    int32_t x1;
+    int32_t y1;
+    int32_t x2;
+    int32_t y2;
+} TileArea;
+
+/*
+ * Grid of fixed size tiles over the display. Invalidated areas mark the tiles
+ * they touch, and the dirty tiles come back as a few disjoint rectangles:
+ * runs of tiles on a row, stacked while the rows below repeat the same run.
+ */
+class DirtyTileMap {
+public:
+    DirtyTileMap(int32_t tileSize);
+    ~DirtyTileMap() = default;
+
+    void resize(int32_t width, int32_t height);
+
+    void mark(const TileArea& area);
+    void clear();
+
+    bool empty() const {
+        return mDirtyCount == 0;
+    }
+    uint32_t dirtyCount() const {
+        return mDirtyCount;
+    }
+
+    /* fills at most maxCount rectangles, returns 0 when more would be needed */
+    uint32_t collect(TileArea* areas, uint32_t maxCount) const;
+
+    DISALLOW_COPY_AND_ASSIGN(DirtyTileMap);
+
+private:
+    int32_t mTileSize;
+    int32_t mWidth;
+    int32_t mHeight;
+    int32_t mColumns;
+    int32_t mRows;
+    uint32_t mDirtyCount;
+    std::vector<uint8_t> mTiles;
+};
+
+} // namespace wm
+} // namespace os
@@ -22,6 +22,15 @@
 
 #include "../common/WindowUtils.h"
 #include "WindowManagerService.h"
+#ifdef CONFIG_SYSTEM_WINDOW_COMPOSITION_CACHE
+#include "CompositionCache.h"
+#endif
+#if defined(CONFIG_SYSTEM_WINDOW_BLIT_WORKERS) && CONFIG_SYSTEM_WINDOW_BLIT_WORKERS > 0
+#include "lvgl/lv_mainwnd_blit.h"
+#endif
+#ifdef CONFIG_SYSTEM_WINDOW_SCANOUT_BYPASS
+#include <string.h>
+#endif
 
 namespace os {
 namespace wm {
@@ -29,12 +38,42 @@ namespace wm {
 static void vsyncEventReceived(lv_event_t* e);
 #endif
 
+#ifndef CONFIG_SYSTEM_WINDOW_VSYNC_APP_OFFSET
+#define CONFIG_SYSTEM_WINDOW_VSYNC_APP_OFFSET 0
+#endif
+
+#ifndef CONFIG_SYSTEM_WINDOW_VSYNC_COMPOSITOR_OFFSET
+#define CONFIG_SYSTEM_WINDOW_VSYNC_COMPOSITOR_OFFSET 0
+#endif
+
+/* time from the window vsync to the next display refresh, 0 means same phase */
+static constexpr int32_t VSYNC_PHASE_DIFF =
+        CONFIG_SYSTEM_WINDOW_VSYNC_COMPOSITOR_OFFSET - CONFIG_SYSTEM_WINDOW_VSYNC_APP_OFFSET;
+static constexpr int32_t VSYNC_PHASE_DELAY =
+        (VSYNC_PHASE_DIFF % LV_DEF_REFR_PERIOD + LV_DEF_REFR_PERIOD) % LV_DEF_REFR_PERIOD;
+
 RootContainer::RootContainer(DeviceEventListener* listener, uv_loop_t* loop)
       : mListener(listener),
         mDisp(nullptr),
         mVsyncEnabled(false),
 #ifndef CONFIG_SYSTEM_WINDOW_USE_VSYNC_EVENT
         mVsyncTimer(nullptr),
+#endif
+#ifdef CONFIG_SYSTEM_WINDOW_SCANOUT_BYPASS
+        mScanoutWindow(nullptr),
+        mScanoutBuffer(nullptr),
+#endif
+#ifdef CONFIG_SYSTEM_WINDOW_COMPOSITION_CACHE
+        mCompositionCache(nullptr),
+#endif
+#ifdef CONFIG_SYSTEM_WINDOW_DIRTY_TILES
+        mDirtyTiles(CONFIG_SYSTEM_WINDOW_DIRTY_TILE_SIZE),
+#endif
+#ifdef CONFIG_SYSTEM_WINDOW_VSYNC_MODEL
+        mVsyncModel(LV_DEF_REFR_PERIOD * 1000, CONFIG_SYSTEM_WINDOW_VSYNC_MODEL_ERROR_US,
+                    CONFIG_SYSTEM_WINDOW_VSYNC_MODEL_RESYNC_MS * 1000),
+        mModelTimer(nullptr),
+        mHwVsyncEnabled(false),
 #endif
         mUvData(nullptr),
         mUvLoop(loop),
@@ -49,7 +88,19 @@ RootContainer::RootContainer(DeviceEventListener* listener, uv_loop_t* loop)
 RootContainer::~RootContainer() {
     LV_GLOBAL_DEFAULT()->user_data = nullptr;
 
-#ifdef CONFIG_SYSTEM_WINDOW_USE_VSYNC_EVENT
+#ifdef CONFIG_SYSTEM_WINDOW_COMPOSITION_CACHE
+    delete mCompositionCache;
+    mCompositionCache = nullptr;
+#endif
+
+#if defined(CONFIG_SYSTEM_WINDOW_BLIT_WORKERS) && CONFIG_SYSTEM_WINDOW_BLIT_WORKERS > 0
+    lv_mainwnd_blit_deinit();
+#endif
+
+#ifdef CONFIG_SYSTEM_WINDOW_VSYNC_MODEL
+    setHwVsyncEnabled(false);
+    if (mModelTimer) lv_timer_del(mModelTimer);
+#elif defined(CONFIG_SYSTEM_WINDOW_USE_VSYNC_EVENT)
     if (mVsyncEnabled && mDisp) lv_display_unregister_vsync_event(mDisp, vsyncEventReceived, this);
 #else
     if (mVsyncTimer) lv_timer_del(mVsyncTimer);
@@ -97,7 +148,11 @@ static void vsyncEventReceived(lv_event_t* e) {
 
         RootContainer* container = reinterpret_cast<RootContainer*>(lv_event_get_user_data(e));
         if (container && container->vsyncEnabled()) {
+#ifdef CONFIG_SYSTEM_WINDOW_VSYNC_MODEL
+            container->onHwVsync();
+#else
             container->processVsyncEvent();
+#endif
         }
 
         WM_PROFILER_END();
@@ -117,11 +172,21 @@ static void asyncEnableVsync(lv_timer_t* tmr) {
     }
 }
 
+#ifdef CONFIG_SYSTEM_WINDOW_VSYNC_MODEL
+static void modelVsyncCallback(lv_timer_t* tmr) {
+    RootContainer* container = static_cast<RootContainer*>(lv_timer_get_user_data(tmr));
+    if (container) {
+        container->onModelVsync();
+    }
+}
+#endif
+
 #else
 static void vsyncCallback(lv_timer_t* tmr) {
     RootContainer* container = static_cast<RootContainer*>(lv_timer_get_user_data(tmr));
     if (container) {
         container->processVsyncEvent();
+        if (VSYNC_PHASE_DELAY > 0) container->alignRefreshPhase();
     }
 }
 #endif
@@ -135,17 +200,26 @@ void RootContainer::enableVsync(bool enable) {
 
     FLOGI("%s fb vsync event", enable ? "enable" : "disable");
     mVsyncEnabled = enable;
-#ifdef CONFIG_SYSTEM_WINDOW_USE_VSYNC_EVENT
+#ifdef CONFIG_SYSTEM_WINDOW_VSYNC_MODEL
+    if (enable && mVsyncModel.isLocked()) {
+        scheduleModelVsync(curSysTimeUs());
+    } else if (enable) {
+        setHwVsyncEnabled(true);
+    } else {
+        setHwVsyncEnabled(false);
+        if (mModelTimer) lv_timer_pause(mModelTimer);
+    }
+#elif defined(CONFIG_SYSTEM_WINDOW_USE_VSYNC_EVENT)
 #if 0
     lv_timer_t* timer = lv_timer_create(asyncEnableVsync, 0, this);
     lv_timer_set_repeat_count(timer, 1);
 #else
     if (vsyncEnabled()) {
         FLOGD("register vsync event");
-        lv_display_register_vsync_event(container->getRoot(), vsyncEventReceived, container);
+        lv_display_register_vsync_event(mDisp, vsyncEventReceived, this);
     } else {
         FLOGD("unregister vsync event");
-        lv_display_unregister_vsync_event(container->getRoot(), vsyncEventReceived, container);
+        lv_display_unregister_vsync_event(mDisp, vsyncEventReceived, this);
     }
 #endif
 #else
@@ -162,6 +236,74 @@ void RootContainer::enableVsync(bool enable) {
     WM_PROFILER_END();
 }
 
+void RootContainer::requestRefresh() {
+    /* display refresh timer pauses itself when nothing is invalid */
+    lv_timer_t* timer = mDisp ? lv_display_get_refr_timer(mDisp) : nullptr;
+    if (timer) lv_timer_resume(timer);
+}
+
+void RootContainer::alignRefreshPhase() {
+    lv_timer_t* timer = mDisp ? lv_display_get_refr_timer(mDisp) : nullptr;
+    if (!timer) return;
+
+    /* the refresh timer runs once its period has elapsed since last_run */
+    timer->last_run = lv_tick_get() - timer->period + VSYNC_PHASE_DELAY;
+}
+
+uint32_t RootContainer::vsyncLatchDelay() {
+    if (VSYNC_PHASE_DELAY > 0) return VSYNC_PHASE_DELAY;
+    /* windows are woken right after the refresh latched, so the next one takes it */
+    return LV_DEF_REFR_PERIOD;
+}
+
+#ifdef CONFIG_SYSTEM_WINDOW_VSYNC_MODEL
+void RootContainer::setHwVsyncEnabled(bool enable) {
+    if (mHwVsyncEnabled == enable || !mDisp) return;
+
+    FLOGD("%s vsync event", enable ? "register" : "unregister");
+    mHwVsyncEnabled = enable;
+    if (enable) {
+        lv_display_register_vsync_event(mDisp, vsyncEventReceived, this);
+    } else {
+        lv_display_unregister_vsync_event(mDisp, vsyncEventReceived, this);
+    }
+}
+
+void RootContainer::scheduleModelVsync(uint64_t now) {
+    if (!mModelTimer) mModelTimer = lv_timer_create(modelVsyncCallback, LV_DEF_REFR_PERIOD, this);
+
+    uint64_t delay = (mVsyncModel.computeNextVsync(now) - now + 500) / 1000;
+    lv_timer_set_period(mModelTimer, delay > 0 ? delay : 1);
+    lv_timer_reset(mModelTimer);
+    lv_timer_resume(mModelTimer);
+}
+
+void RootContainer::onHwVsync() {
+    uint64_t now = curSysTimeUs();
+    bool wasLocked = mVsyncModel.isLocked();
+    bool learning = mVsyncModel.addVsyncSample(now);
+
+    /* while learning the events drive windows, a verifying sample doesn't */
+    if (learning || !wasLocked) processVsyncEvent();
+
+    if (learning) {
+        if (mModelTimer) lv_timer_pause(mModelTimer);
+        return;
+    }
+
+    setHwVsyncEnabled(false);
+    scheduleModelVsync(now);
+}
+
+void RootContainer::onModelVsync() {
+    processVsyncEvent();
+
+    uint64_t now = curSysTimeUs();
+    if (mVsyncModel.needsResync(now)) setHwVsyncEnabled(true);
+    if (mVsyncEnabled) scheduleModelVsync(now);
+}
+#endif
+
 void RootContainer::processVsyncEvent() {
     WM_PROFILER_BEGIN();
     if (mListener) {
@@ -232,6 +374,20 @@ static void processDispEvent(lv_event_t* e) {
             container->onFrameFinished();
             break;
         }
+#ifdef CONFIG_SYSTEM_WINDOW_SCANOUT_BYPASS
+        case LV_EVENT_FLUSH_START: {
+            CONTAINER_FROM_EVENT(e);
+            container->onFlushStart((const lv_area_t*)lv_event_get_param(e));
+            break;
+        }
+#endif
+#ifdef CONFIG_SYSTEM_WINDOW_DIRTY_TILES
+        case LV_EVENT_INVALIDATE_AREA: {
+            CONTAINER_FROM_EVENT(e);
+            container->onInvalidateArea((const lv_area_t*)lv_event_get_param(e));
+            break;
+        }
+#endif
         default:
             break;
     }
@@ -244,20 +400,78 @@ void RootContainer::onFrameStart() {
         info->markLayoutStart();
     }
 
+    /* latch window states before this refresh walks the invalid areas */
+    if (mListener) mListener->responseFrameStart();
+
+#ifdef CONFIG_SYSTEM_WINDOW_DIRTY_TILES
+    applyDirtyTiles();
+#endif
+
+#ifdef CONFIG_SYSTEM_WINDOW_SCANOUT_BYPASS
+    scanoutBypass();
+#endif
+
 #ifndef CONFIG_SYSTEM_WINDOW_USE_VSYNC_EVENT
-    if (!mVsyncTimer->paused) {
+    /* with a phase offset the vsync timer runs on its own and leads the refresh */
+    if (VSYNC_PHASE_DELAY == 0 && !mVsyncTimer->paused) {
         lv_timer_reset(mVsyncTimer);
         if (mVsyncTimer->timer_cb) mVsyncTimer->timer_cb(mVsyncTimer);
     }
 #endif
 }
 
+#ifdef CONFIG_SYSTEM_WINDOW_DIRTY_TILES
+void RootContainer::onInvalidateArea(const lv_area_t* area) {
+    if (!area) {
+        mDirtyTiles.clear();
+        return;
+    }
+    /* LVGL sends the area clipped to the screen, empty when nothing is left */
+    if (area->x1 > area->x2 || area->y1 > area->y2) return;
+    mDirtyTiles.mark({area->x1, area->y1, area->x2, area->y2});
+}
+
+void RootContainer::applyDirtyTiles() {
+    if (mDirtyTiles.empty()) return;
+
+    /* lv_inv_area(disp, NULL) drops the invalid areas without an event */
+    if (mDisp->inv_p == 0) {
+        mDirtyTiles.clear();
+        return;
+    }
+
+    /* the map is cleared at REFR_READY, the layout pass may still mark tiles */
+    TileArea areas[LV_INV_BUF_SIZE];
+    uint32_t count = mDirtyTiles.collect(areas, LV_INV_BUF_SIZE);
+
+    /* too scattered for the invalid area list, keep what LVGL collected */
+    if (count == 0 || mDisp->render_mode == LV_DISPLAY_RENDER_MODE_FULL) return;
+
+    /* disjoint tile runs, LVGL will not join them into larger boxes */
+    for (uint32_t i = 0; i < count; i++) {
+        lv_area_set(&mDisp->inv_areas[i], areas[i].x1, areas[i].y1, areas[i].x2, areas[i].y2);
+        mDisp->inv_area_joined[i] = 0;
+    }
+    mDisp->inv_p = count;
+}
+#endif
+
 void RootContainer::onRenderStart() {
+#ifdef CONFIG_SYSTEM_WINDOW_COMPOSITION_CACHE
+    if (mCompositionCache) mCompositionCache->onRenderStart();
+#endif
     if (!mTraceFrame) return;
     mFrameInfo.markRenderStart();
 }
 
 void RootContainer::onFrameFinished() {
+#ifdef CONFIG_SYSTEM_WINDOW_COMPOSITION_CACHE
+    if (mCompositionCache) mCompositionCache->onRenderFinished();
+#endif
+#ifdef CONFIG_SYSTEM_WINDOW_DIRTY_TILES
+    /* everything marked up to here was drawn in this refresh */
+    mDirtyTiles.clear();
+#endif
     if (!mTraceFrame) return;
 
     mFrameInfo.markRenderEnd();
@@ -302,6 +516,20 @@ bool RootContainer::init() {
     mVsyncTimer = lv_timer_create(vsyncCallback, LV_DEF_REFR_PERIOD, this);
 #endif
     lv_display_add_event_cb(mDisp, processDispEvent, LV_EVENT_ALL, this);
+#ifdef CONFIG_SYSTEM_WINDOW_COMPOSITION_CACHE
+    mCompositionCache = new CompositionCache(mDisp, getDefLayer());
+#endif
+#ifdef CONFIG_SYSTEM_WINDOW_DIRTY_TILES
+    mDirtyTiles.resize(lv_display_get_horizontal_resolution(mDisp),
+                       lv_display_get_vertical_resolution(mDisp));
+#endif
+#if defined(CONFIG_SYSTEM_WINDOW_BLIT_WORKERS) && CONFIG_SYSTEM_WINDOW_BLIT_WORKERS > 0
+    uint32_t workers = lv_mainwnd_blit_init(CONFIG_SYSTEM_WINDOW_BLIT_WORKERS);
+    if (workers < CONFIG_SYSTEM_WINDOW_BLIT_WORKERS) {
+        FLOGW("only %" PRIu32 " of %d blit workers started", workers,
+              CONFIG_SYSTEM_WINDOW_BLIT_WORKERS);
+    }
+#endif
 
     if (mListener) {
         LV_GLOBAL_DEFAULT()->user_data = this;
@@ -315,6 +543,106 @@ bool RootContainer::init() {
     return mDisp ? true : false;
 }
 
+#ifdef CONFIG_SYSTEM_WINDOW_SCANOUT_BYPASS
+lv_obj_t* RootContainer::findScanoutWindow() {
+    lv_obj_t* layers[] = {getDefLayer(), getTopLayer(), getSysLayer()};
+    lv_obj_t* found = nullptr;
+
+    /* any other visible object needs LVGL to compose the screen */
+    for (auto layer : layers) {
+        uint32_t count = lv_obj_get_child_count(layer);
+        for (uint32_t i = 0; i < count; i++) {
+            lv_obj_t* child = lv_obj_get_child(layer, i);
+            if (lv_obj_has_flag(child, LV_OBJ_FLAG_HIDDEN)) continue;
+#ifdef CONFIG_SYSTEM_WINDOW_COMPOSITION_CACHE
+            if (mCompositionCache && child == mCompositionCache->getObject()) continue;
+#endif
+            if (found || !lv_obj_check_type(child, &lv_mainwnd_class)) return nullptr;
+            found = child;
+        }
+    }
+    return found;
+}
+
+static void copyArea(uint8_t* dst, uint32_t dstStride, const uint8_t* src, uint32_t srcStride,
+                     const lv_area_t* area, uint32_t pixelSize) {
+    uint32_t offset = area->x1 * pixelSize;
+    uint32_t size = lv_area_get_width(area) * pixelSize;
+    for (int32_t y = area->y1; y <= area->y2; y++) {
+        memcpy(dst + y * dstStride + offset, src + y * srcStride + offset, size);
+    }
+}
+
+void RootContainer::leaveScanout() {
+    if (!mScanoutWindow) return;
+
+    FLOGI("leave scanout bypass");
+    if (lv_obj_is_valid(mScanoutWindow)) {
+        lv_mainwnd_update_flag(mScanoutWindow, LV_MAINWND_FLAG_SKIP_DRAW, false);
+    }
+    mScanoutWindow = nullptr;
+    mScanoutBuffer = nullptr;
+
+    /* the layer was not drawn while bypassing, compose all of it again */
+#ifdef CONFIG_SYSTEM_WINDOW_COMPOSITION_CACHE
+    if (mCompositionCache) {
+        mCompositionCache->drop();
+        return;
+    }
+#endif
+    lv_obj_invalidate(getDefLayer());
+}
+
+bool RootContainer::scanoutBypass() {
+    /* the draw buffer must be the whole screen to take the copy in place */
+    lv_obj_t* win = mDisp->render_mode != LV_DISPLAY_RENDER_MODE_PARTIAL ? findScanoutWindow()
+                                                                         : nullptr;
+    const lv_mainwnd_buf_dsc_t* buf =
+            win ? lv_mainwnd_get_scanout_buffer(win, lv_display_get_color_format(mDisp))
+                : nullptr;
+    if (!buf) {
+        leaveScanout();
+        return false;
+    }
+
+    if (win != mScanoutWindow) {
+        leaveScanout();
+        FLOGI("enter scanout bypass");
+        lv_mainwnd_update_flag(win, LV_MAINWND_FLAG_SKIP_DRAW, true);
+        /* the draw buffer holds what LVGL composed, replace all of it once */
+        lv_obj_invalidate(win);
+        mScanoutWindow = win;
+    }
+    mScanoutBuffer = buf;
+    return true;
+}
+
+void RootContainer::onFlushStart(const lv_area_t* area) {
+    if (!mScanoutBuffer || !area) return;
+
+    /*
+     * LVGL flushes the areas it refreshed from the buffer it is about to show,
+     * the display driver pans to it at vsync as for any composed frame. The
+     * window was not drawn there, copy its buffer in instead.
+     */
+    lv_draw_buf_t* drawBuf = mDisp->buf_act;
+    if (!drawBuf || !drawBuf->data) return;
+
+    WM_PROFILER_BEGIN();
+    const lv_image_dsc_t* src = &mScanoutBuffer->img_dsc;
+    uint32_t srcStride = src->header.stride;
+    if (srcStride == 0) srcStride = lv_draw_buf_width_to_stride(src->header.w, src->header.cf);
+
+    lv_area_t copy;
+    lv_area_t screen = {0, 0, (int32_t)src->header.w - 1, (int32_t)src->header.h - 1};
+    if (_lv_area_intersect(&copy, area, &screen)) {
+        copyArea(drawBuf->data, drawBuf->header.stride, src->data, srcStride, &copy,
+                 lv_color_format_get_size(src->header.cf));
+    }
+    WM_PROFILER_END();
+}
+#endif
+
 bool RootContainer::getDisplayInfo(DisplayInfo* info) {
     if (info) {
         info->width = lv_disp_get_hor_res(mDisp);
@@ -325,6 +653,10 @@ bool RootContainer::getDisplayInfo(DisplayInfo* info) {
     return false;
 }
 
+lv_color_format_t RootContainer::getDisplayFormat() {
+    return mDisp ? lv_display_get_color_format(mDisp) : LV_COLOR_FORMAT_UNKNOWN;
+}
+
 static lv_anim_t* toast_fade_in(lv_obj_t* obj, uint32_t time, uint32_t delay);
 static lv_anim_t* toast_fade_out(lv_obj_t* obj, uint32_t time, uint32_t delay);
 
@@ -22,10 +22,23 @@
 
 #include "../common/FrameTimeInfo.h"
 #include "DeviceEventListener.h"
+#ifdef CONFIG_SYSTEM_WINDOW_VSYNC_MODEL
+#include "VsyncModel.h"
+#endif
+#ifdef CONFIG_SYSTEM_WINDOW_DIRTY_TILES
+#include "DirtyTileMap.h"
+#endif
+#ifdef CONFIG_SYSTEM_WINDOW_SCANOUT_BYPASS
+#include "lvgl/lv_mainwnd.h"
+#endif
 
 namespace os {
 namespace wm {
 
+#ifdef CONFIG_SYSTEM_WINDOW_COMPOSITION_CACHE
+class CompositionCache;
+#endif
+
 class RootContainer {
 public:
     RootContainer(DeviceEventListener* listener, uv_loop_t* loop);
@@ -37,9 +50,17 @@ public:
     lv_obj_t* getTopLayer();
 
     bool getDisplayInfo(DisplayInfo* info);
+    lv_color_format_t getDisplayFormat();
 
     void enableVsync(bool enable);
+    void requestRefresh();
     void processVsyncEvent();
+    void alignRefreshPhase();
+    uint32_t vsyncLatchDelay();
+#ifdef CONFIG_SYSTEM_WINDOW_VSYNC_MODEL
+    void onHwVsync();
+    void onModelVsync();
+#endif
 
     void showToast(const char* text, uint32_t duration);
 
@@ -55,6 +76,9 @@ public:
     FrameMetaInfo* frameInfo();
 
     void onFrameStart();
+#ifdef CONFIG_SYSTEM_WINDOW_DIRTY_TILES
+    void onInvalidateArea(const lv_area_t* area);
+#endif
     void onRenderStart();
     void onFrameFinished();
     void traceFrame(bool enable);
@@ -68,6 +92,32 @@ private:
     bool mVsyncEnabled;
 #ifndef CONFIG_SYSTEM_WINDOW_USE_VSYNC_EVENT
     lv_timer_t* mVsyncTimer;
+#endif
+#ifdef CONFIG_SYSTEM_WINDOW_SCANOUT_BYPASS
+    lv_obj_t* findScanoutWindow();
+    bool scanoutBypass();
+    void leaveScanout();
+    void onFlushStart(const lv_area_t* area);
+
+    /* window whose buffer is copied into the draw buffer at flush */
+    lv_obj_t* mScanoutWindow;
+    const lv_mainwnd_buf_dsc_t* mScanoutBuffer;
+#endif
+#ifdef CONFIG_SYSTEM_WINDOW_COMPOSITION_CACHE
+    CompositionCache* mCompositionCache;
+#endif
+#ifdef CONFIG_SYSTEM_WINDOW_DIRTY_TILES
+    void applyDirtyTiles();
+
+    DirtyTileMap mDirtyTiles;
+#endif
+#ifdef CONFIG_SYSTEM_WINDOW_VSYNC_MODEL
+    void setHwVsyncEnabled(bool enable);
+    void scheduleModelVsync(uint64_t now);
+
+    VsyncModel mVsyncModel;
+    lv_timer_t* mModelTimer;
+    bool mHwVsyncEnabled;
 #endif
     void* mUvData;
     uv_loop_t* mUvLoop;
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "WMS:BufferPool"
+
+#include "SurfaceBufferPool.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../common/WindowUtils.h"
+
+namespace os {
+namespace wm {
+
+SurfaceBufferPool::SurfaceBufferPool(uint32_t capacity) : mCapacity(capacity) {}
+
+SurfaceBufferPool::~SurfaceBufferPool() {
+    clear();
+}
+
+bool SurfaceBufferPool::obtain(int32_t pid, uint32_t size, uint32_t format, uint32_t count,
+                               std::vector<BufferId>& ids) {
+    for (auto it = mSurfaces.begin(); it != mSurfaces.end(); ++it) {
+        if (it->mPid == pid && it->mSize == size && it->mFormat == format &&
+            it->mIds.size() == count) {
+            ids = it->mIds;
+            mSurfaces.erase(it);
+
+            FLOGI("[%" PRId32 "] reuse %" PRIu32 " buffers of size %" PRIu32 ", format %" PRIu32
+                  "",
+                  pid, count, size, format);
+            return true;
+        }
+    }
+    return false;
+}
+
+void SurfaceBufferPool::recycle(int32_t pid, uint32_t size, uint32_t format,
+                                const std::vector<BufferId>& ids) {
+    if (ids.empty()) return;
+
+    /* the surface closes its own descriptors with the buffer queue */
+    PooledSurface surface = {pid, size, format, {}};
+    bool valid = true;
+    for (const auto& id : ids) {
+        BufferId buffer = {id.mName, id.mKey, id.mFd > 0 ? dup(id.mFd) : -1};
+        if (buffer.mFd < 0) {
+            FLOGE("failed to keep buffer %s, %s", id.mName.c_str(), strerror(errno));
+            valid = false;
+        }
+        surface.mIds.push_back(buffer);
+    }
+
+    /* a surface is only reused as a whole */
+    if (!valid) {
+        evict(surface);
+        return;
+    }
+    mSurfaces.push_back(surface);
+
+    while (mSurfaces.size() > mCapacity) {
+        evict(mSurfaces.front());
+        mSurfaces.pop_front();
+    }
+}
+
+void SurfaceBufferPool::release(int32_t pid) {
+    for (auto it = mSurfaces.begin(); it != mSurfaces.end();) {
+        if (it->mPid == pid) {
+            evict(*it);
+            it = mSurfaces.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void SurfaceBufferPool::clear() {
+    for (const auto& surface : mSurfaces) {
+        evict(surface);
+    }
+    mSurfaces.clear();
+}
+
+void SurfaceBufferPool::evict(const PooledSurface& surface) {
+    for (const auto& id : surface.mIds) {
+        int result = shm_unlink(id.mName.c_str());
+        FLOGI("release pooled buffer %s, result=%d", id.mName.c_str(), result);
+
+        if (id.mFd > 0) {
+            close(id.mFd);
+        }
+    }
+}
+
+} // namespace wm
+} // namespace os
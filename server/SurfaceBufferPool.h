@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/macros.h>
+
+#include <list>
+#include <vector>
+
+#include "wm/BufferQueue.h"
+
+namespace os {
+namespace wm {
+
+/*
+ * Keeps the shared memory of destroyed surfaces alive, so that a surface
+ * with the same buffer size, format and buffer count can be created
+ * without shm_open, ftruncate and first-touch page faults. Buffers are
+ * pooled per surface, the capacity counts surfaces. Buffer names stay
+ * linked while they are pooled and are unlinked when evicted. Buffers only
+ * go back to the client process they came from, which may still have them
+ * mapped. The pool owns the names it is given and unlinks what it cannot keep.
+ */
+class SurfaceBufferPool {
+public:
+    SurfaceBufferPool(uint32_t capacity);
+    ~SurfaceBufferPool();
+
+    bool obtain(int32_t pid, uint32_t size, uint32_t format, uint32_t count,
+                std::vector<BufferId>& ids);
+    void recycle(int32_t pid, uint32_t size, uint32_t format, const std::vector<BufferId>& ids);
+    void release(int32_t pid);
+    void clear();
+
+    uint32_t size() const {
+        return mSurfaces.size();
+    }
+
+    DISALLOW_COPY_AND_ASSIGN(SurfaceBufferPool);
+
+private:
+    typedef struct {
+        int32_t mPid;
+        uint32_t mSize;
+        uint32_t mFormat;
+        std::vector<BufferId> mIds;
+    } PooledSurface;
+
+    void evict(const PooledSurface& surface);
+
+    uint32_t mCapacity;
+    std::list<PooledSurface> mSurfaces;
+};
+
+} // namespace wm
+} // namespace os
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "WMS:VsyncModel"
+
+#include "VsyncModel.h"
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "../common/WindowUtils.h"
+
+namespace os {
+namespace wm {
+
+VsyncModel::VsyncModel(uint64_t nominalPeriod, uint64_t errorThreshold, uint64_t resyncInterval)
+      : mNominalPeriod(nominalPeriod),
+        mErrorThreshold(errorThreshold),
+        mResyncInterval(resyncInterval) {
+    reset();
+}
+
+void VsyncModel::reset() {
+    mFirstSample = 0;
+    mNumSamples = 0;
+    mPeriod = mNominalPeriod;
+    mReference = 0;
+    mLastSampleTime = 0;
+    mLastError = 0;
+    mLocked = false;
+}
+
+bool VsyncModel::addVsyncSample(uint64_t timestamp) {
+    if (mLocked) {
+        mLastError = errorOf(timestamp);
+        if (llabs(mLastError) <= (int64_t)mErrorThreshold) {
+            /* follow the slow drift of the panel */
+            mReference = timestamp;
+            mLastSampleTime = timestamp;
+            return false;
+        }
+
+        FLOGI("vsync error %" PRId64 "us, resync", mLastError);
+        reset();
+    }
+
+    if (mNumSamples > 0) {
+        uint64_t last = mSamples[(mFirstSample + mNumSamples - 1) % MAX_SAMPLES];
+        if (timestamp <= last) return true;
+    }
+
+    if (mNumSamples < MAX_SAMPLES) {
+        mSamples[(mFirstSample + mNumSamples) % MAX_SAMPLES] = timestamp;
+        mNumSamples++;
+    } else {
+        mSamples[mFirstSample] = timestamp;
+        mFirstSample = (mFirstSample + 1) % MAX_SAMPLES;
+    }
+    mLastSampleTime = timestamp;
+
+    if (mNumSamples < MIN_SAMPLES) return true;
+
+    mLocked = updateModel();
+    if (mLocked) FLOGI("locked period=%" PRIu64 "us", mPeriod);
+    return !mLocked;
+}
+
+uint64_t VsyncModel::computeNextVsync(uint64_t now) const {
+    if (mReference == 0 || mPeriod == 0) return now + mNominalPeriod;
+    if (now < mReference) return mReference;
+
+    uint64_t periods = (now - mReference) / mPeriod + 1;
+    return mReference + periods * mPeriod;
+}
+
+bool VsyncModel::needsResync(uint64_t now) const {
+    return mLocked && now - mLastSampleTime >= mResyncInterval;
+}
+
+int64_t VsyncModel::errorOf(uint64_t timestamp) const {
+    if (mReference == 0 || mPeriod == 0) return 0;
+
+    int64_t period = (int64_t)mPeriod;
+    int64_t diff = (int64_t)(timestamp - mReference);
+    int64_t periods = diff >= 0 ? (diff + period / 2) / period : -((period / 2 - diff) / period);
+    return diff - periods * period;
+}
+
+bool VsyncModel::updateModel() {
+    /* missed vsyncs show up as gaps of several periods */
+    uint64_t estimate = mPeriod > 0 ? mPeriod : mNominalPeriod;
+    uint64_t intervals = 0;
+    for (uint32_t i = 1; i < mNumSamples; i++) {
+        uint64_t prev = mSamples[(mFirstSample + i - 1) % MAX_SAMPLES];
+        uint64_t cur = mSamples[(mFirstSample + i) % MAX_SAMPLES];
+        uint64_t periods = (cur - prev + estimate / 2) / estimate;
+        if (periods == 0) return false;
+        intervals += periods;
+    }
+
+    uint64_t first = mSamples[mFirstSample];
+    uint64_t last = mSamples[(mFirstSample + mNumSamples - 1) % MAX_SAMPLES];
+    mPeriod = (last - first) / intervals;
+    mReference = last;
+
+    /* anchor the phase on the mean error, lock when every sample fits */
+    int64_t sum = 0;
+    int64_t maxError = 0;
+    for (uint32_t i = 0; i < mNumSamples; i++) {
+        int64_t error = errorOf(mSamples[(mFirstSample + i) % MAX_SAMPLES]);
+        sum += error;
+        if (llabs(error) > maxError) maxError = llabs(error);
+    }
+    mReference = (uint64_t)((int64_t)mReference + sum / (int64_t)mNumSamples);
+    mLastError = maxError;
+
+    return maxError <= (int64_t)mErrorThreshold;
+}
+
+} // namespace wm
+} // namespace os
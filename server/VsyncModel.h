@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <android-base/macros.h>
+#include <stdint.h>
+
+namespace os {
+namespace wm {
+
+/*
+ * Software vsync model, learns the period and phase of the panel from a few
+ * hardware vsync timestamps and predicts the following ones. Once locked,
+ * hardware vsync is only sampled again every resync interval to check the
+ * prediction, a sample off by more than the error threshold drops the lock.
+ * All times are in microseconds.
+ */
+class VsyncModel {
+public:
+    VsyncModel(uint64_t nominalPeriod, uint64_t errorThreshold, uint64_t resyncInterval);
+    ~VsyncModel() = default;
+
+    void reset();
+
+    /* feeds a hardware vsync, returns true while more samples are wanted */
+    bool addVsyncSample(uint64_t timestamp);
+
+    /* predicted time of the first vsync after now */
+    uint64_t computeNextVsync(uint64_t now) const;
+
+    /* the locked model is due for a hardware sample to verify it */
+    bool needsResync(uint64_t now) const;
+
+    bool isLocked() const {
+        return mLocked;
+    }
+    uint64_t getPeriod() const {
+        return mPeriod;
+    }
+    int64_t getLastError() const {
+        return mLastError;
+    }
+
+    DISALLOW_COPY_AND_ASSIGN(VsyncModel);
+
+private:
+    static constexpr uint32_t MIN_SAMPLES = 4;
+    static constexpr uint32_t MAX_SAMPLES = 8;
+
+    int64_t errorOf(uint64_t timestamp) const;
+    bool updateModel();
+
+    uint64_t mNominalPeriod;
+    uint64_t mErrorThreshold;
+    uint64_t mResyncInterval;
+
+    uint64_t mSamples[MAX_SAMPLES];
+    uint32_t mFirstSample;
+    uint32_t mNumSamples;
+
+    uint64_t mPeriod;
+    uint64_t mReference;
+    uint64_t mLastSampleTime;
+    int64_t mLastError;
+    bool mLocked;
+};
+
+} // namespace wm
+} // namespace os
@@ -206,16 +206,21 @@ void WindowManagerService::WindowDeathRecipient::binderDied(const wp<IBinder>& w
     auto key = who.promote();
     auto it = mService->mWindowMap.find(key);
     if (it != mService->mWindowMap.end()) {
+        int32_t pid = it->second->getClientPid();
         it->second->removeIfPossible();
+        /* nobody is left to hand the buffers of a dead process back to */
+        mService->mBufferPool.release(pid);
     }
 }
 
 WindowManagerService::WindowManagerService(std::shared_ptr<::os::app::UvLoop> uvLooper)
-      : mUvLooper(uvLooper),
+      : mVsyncRequesters(nullptr),
+        mUvLooper(uvLooper),
 #ifdef CONFIG_ENABLE_TRANSITION_ANIMATION
         mWinAnimEngine(nullptr),
 #endif
-        mGestureDetector(mUvLooper) {
+        mGestureDetector(mUvLooper),
+        mBufferPool(CONFIG_ENABLE_WINDOW_BUFFER_POOL_MAX) {
     FLOGI("WMS init");
     mContainer = new RootContainer(this, mUvLooper->get());
     DisplayInfo disp_info;
@@ -305,8 +310,10 @@ Status WindowManagerService::addWindow(const sp<IWindow>& window, const LayoutPa
         }
     }
 
-    WindowState* win = new WindowState(this, window, winToken, attrs, visibility,
-                                       outInputChannel != nullptr ? true : false);
+    LayoutParams newAttrs = attrs;
+    newAttrs.mFormat = resolveFormat(attrs.mFormat);
+    WindowState* win = new WindowState(this, window, winToken, newAttrs, visibility,
+                                       outInputChannel != nullptr ? true : false, pid);
     client->linkToDeath(mWindowDeathRecipient);
     mWindowMap.emplace(client, win);
     winToken->addWindow(win);
@@ -363,17 +370,26 @@ Status WindowManagerService::relayout(const sp<IWindow>& window, const LayoutPar
     }
 
     bool visible = visibility == LayoutParams::WINDOW_VISIBLE ? true : false;
+    LayoutParams newAttrs = attrs;
+    newAttrs.mWidth = requestedWidth;
+    newAttrs.mHeight = requestedHeight;
+    newAttrs.mFormat = resolveFormat(attrs.mFormat);
+
+    if (visible && win->canReuseSurface(newAttrs)) {
+        /* same geometry and format, hand the current surface back */
+        FLOGI("[%" PRId32 "] window(%p) keeps its surface", pid, window.get());
+        win->setLayoutParams(newAttrs);
+        outSurfaceControl->copyFrom(*win->getSurfaceControl());
+        win->setVisibility(visibility);
+        rearmVsync();
+        WM_PROFILER_END();
+        return Status::ok();
+    }
+
     win->destroySurfaceControl();
 
     if (visible) {
-        if (attrs.mWidth != requestedWidth || attrs.mHeight != requestedHeight) {
-            LayoutParams newAttrs = attrs;
-            newAttrs.mWidth = requestedWidth;
-            newAttrs.mHeight = requestedHeight;
-            win->setLayoutParams(newAttrs);
-        } else {
-            win->setLayoutParams(attrs);
-        }
+        win->setLayoutParams(newAttrs);
         *_aidl_return = createSurfaceControl(outSurfaceControl, win);
         if (*_aidl_return != 0) {
             FLOGE("failure, cann't create valid surface!");
@@ -384,6 +400,7 @@ Status WindowManagerService::relayout(const sp<IWindow>& window, const LayoutPar
     }
 
     win->setVisibility(visibility);
+    rearmVsync();
 
     WM_PROFILER_END();
     return *_aidl_return == 0
@@ -469,8 +486,11 @@ Status WindowManagerService::updateWindowTokenVisibility(const sp<IBinder>& toke
 Status WindowManagerService::applyTransaction(const vector<LayerState>& state) {
     WM_PROFILER_BEGIN();
     for (const auto& layerState : state) {
-        if (mWindowMap.find(layerState.mToken) != mWindowMap.end()) {
-            mWindowMap[layerState.mToken]->applyTransaction(layerState);
+        auto it = mWindowMap.find(layerState.mToken);
+        if (it != mWindowMap.end()) {
+            /* keep the order with states already posted to the channel */
+            it->second->drainTransactions();
+            it->second->queueTransaction(layerState);
         }
     }
     WM_PROFILER_END();
@@ -570,17 +590,19 @@ bool WindowManagerService::responseInput(InputMessage* msg) {
 bool WindowManagerService::responseVsync() {
     WM_PROFILER_BEGIN();
 
-    VsyncRequest nextVsync = VsyncRequest::VSYNC_REQ_NONE;
-    for (const auto& [key, state] : mWindowMap) {
-        if (state->isVisible()) {
-            VsyncRequest result = state->onVsync();
-            if (result > nextVsync) {
-                nextVsync = result;
-            }
+    /* a window leaves the list from onVsync when its request is done */
+    bool dispatched = false;
+    WindowState* next = nullptr;
+    for (WindowState* state = mVsyncRequesters; state != nullptr; state = next) {
+        next = state->vsyncLink().mNext;
+        /* a covered window keeps its request, rearmVsync() resumes it once uncovered */
+        if (state->isVisible() && !state->isOccluded()) {
+            state->onVsync();
+            dispatched = true;
         }
     }
 
-    if (nextVsync == VsyncRequest::VSYNC_REQ_NONE) {
+    if (!dispatched) {
         mContainer->enableVsync(false);
     }
 
@@ -588,6 +610,58 @@ bool WindowManagerService::responseVsync() {
     return true;
 }
 
+void WindowManagerService::rearmVsync() {
+    if (mContainer->vsyncEnabled()) return;
+
+    for (WindowState* state = mVsyncRequesters; state != nullptr;
+         state = state->vsyncLink().mNext) {
+        if (state->isVisible() && !state->isOccluded()) {
+            mContainer->enableVsync(true);
+            return;
+        }
+    }
+}
+
+void WindowManagerService::addVsyncRequester(WindowState* state) {
+    auto& link = state->vsyncLink();
+    if (link.mLinked) return;
+
+    link.mPrev = nullptr;
+    link.mNext = mVsyncRequesters;
+    if (mVsyncRequesters) mVsyncRequesters->vsyncLink().mPrev = state;
+    mVsyncRequesters = state;
+    link.mLinked = true;
+
+    /* a covered window waits until it is uncovered */
+    if (state->isVisible() && !state->isOccluded()) mContainer->enableVsync(true);
+}
+
+void WindowManagerService::removeVsyncRequester(WindowState* state) {
+    auto& link = state->vsyncLink();
+    if (!link.mLinked) return;
+
+    if (link.mPrev) {
+        link.mPrev->vsyncLink().mNext = link.mNext;
+    } else {
+        mVsyncRequesters = link.mNext;
+    }
+    if (link.mNext) link.mNext->vsyncLink().mPrev = link.mPrev;
+    link = {nullptr, nullptr, false};
+
+    if (mVsyncRequesters == nullptr) mContainer->enableVsync(false);
+}
+
+bool WindowManagerService::responseFrameStart() {
+    WM_PROFILER_BEGIN();
+    for (const auto& [key, state] : mWindowMap) {
+        state->latchTransaction();
+    }
+    /* whatever uncovers a window also redraws the area it uncovers */
+    rearmVsync();
+    WM_PROFILER_END();
+    return true;
+}
+
 int32_t WindowManagerService::createSurfaceControl(SurfaceControl* outSurfaceControl,
                                                    WindowState* win) {
     vector<BufferId> ids;
@@ -598,6 +672,12 @@ int32_t WindowManagerService::createSurfaceControl(SurfaceControl* outSurfaceCon
     bufferCount = 3;
 #endif
 
+    uint32_t size = win->getSurfaceSize();
+    uint32_t format = win->getLayoutParams().mFormat;
+    if (mBufferPool.obtain(win->getClientPid(), size, format, bufferCount, ids)) {
+        bufferCount = 0;
+    }
+
     for (int32_t i = 0; i < bufferCount; i++) {
         BufferId id;
         std::string bufferPath = genUniquePath(false, pid, "bq");
@@ -609,7 +689,20 @@ int32_t WindowManagerService::createSurfaceControl(SurfaceControl* outSurfaceCon
     }
 
     std::string fmqName = genUniquePath(false, pid, "fakemq");
-    std::shared_ptr<SurfaceControl> surfaceControl = win->createSurfaceControl(ids, fmqName);
+    std::string stateName;
+#ifdef CONFIG_ENABLE_SHARED_BUFFER_STATE
+    stateName = genUniquePath(false, pid, "bstate");
+#endif
+    std::string transName;
+#ifdef CONFIG_ENABLE_TRANSACTION_CHANNEL
+    transName = genUniquePath(false, pid, "trans");
+#endif
+    std::string vsyncName;
+#ifdef CONFIG_ENABLE_VSYNC_CHANNEL
+    vsyncName = genUniquePath(false, pid, "vsync");
+#endif
+    std::shared_ptr<SurfaceControl> surfaceControl =
+            win->createSurfaceControl(ids, fmqName, stateName, transName, vsyncName);
 
     if (!surfaceControl->isValid()) {
         outSurfaceControl = nullptr;
@@ -623,6 +716,39 @@ int32_t WindowManagerService::createSurfaceControl(SurfaceControl* outSurfaceCon
     return 0;
 }
 
+int32_t WindowManagerService::resolveFormat(int32_t format) {
+    if (format != LayoutParams::FORMAT_OPAQUE && format != LayoutParams::FORMAT_TRANSPARENT) {
+        return format;
+    }
+
+    /* the smallest buffer the compositor draws into the display without conversion */
+    lv_color_format_t cf = mContainer->getDisplayFormat();
+    if (format == LayoutParams::FORMAT_OPAQUE) {
+        switch (cf) {
+            case LV_COLOR_FORMAT_RGB565:
+                return LayoutParams::FORMAT_RGB_565;
+            case LV_COLOR_FORMAT_RGB888:
+                return LayoutParams::FORMAT_RGB_888;
+            default:
+                return LayoutParams::FORMAT_XRGB_8888;
+        }
+    }
+
+#ifdef CONFIG_SYSTEM_WINDOW_TRANSPARENT_RGB565A8
+    if (cf == LV_COLOR_FORMAT_RGB565) return LayoutParams::FORMAT_RGB_565A8;
+#endif
+    return LayoutParams::FORMAT_ARGB_8888;
+}
+
+void WindowManagerService::recycleSurfaceBuffers(int32_t pid,
+                                                 const std::shared_ptr<SurfaceControl>& sc) {
+    mBufferPool.recycle(pid, sc->getBufferSize(), sc->getFormat(), sc->bufferIds());
+
+    /* pooled buffers stay linked, only release the queues */
+    sc->clearBufferIds();
+    uninitSurfaceBuffer(sc, true);
+}
+
 #ifdef CONFIG_ENABLE_TRANSITION_ANIMATION
 AnimEngineHandle WindowManagerService::getAnimEngine() {
     return mWinAnimEngine->getEngine();
@@ -22,6 +22,7 @@
 
 #include "DeviceEventListener.h"
 #include "GestureDetector.h"
+#include "SurfaceBufferPool.h"
 #include "WindowConfig.h"
 #include "app/UvLoop.h"
 #include "os/wm/BnWindowManager.h"
@@ -72,18 +73,27 @@ public:
     Status releaseInput(const sp<IBinder>& token);
 
     bool responseVsync() override;
+    bool responseFrameStart() override;
     bool responseInput(InputMessage* msg) override;
 
     RootContainer* getRootContainer() {
         return mContainer;
     }
 
+    uv_loop_t* getUvLoop() {
+        return mUvLooper->get();
+    }
+
 #ifdef CONFIG_ENABLE_TRANSITION_ANIMATION
     AnimEngineHandle getAnimEngine();
     std::string getAnimConfig(bool animMode, WindowState* win);
 #endif
 
     void postWindowRemoveCleanup(WindowState* state);
+    void addVsyncRequester(WindowState* state);
+    void rearmVsync();
+    void removeVsyncRequester(WindowState* state);
+    void recycleSurfaceBuffers(int32_t pid, const std::shared_ptr<SurfaceControl>& sc);
     bool removeWindowTokenInner(sp<IBinder>& token);
 
     bool ready();
@@ -99,9 +109,12 @@ private:
     };
 
     int32_t createSurfaceControl(SurfaceControl* outSurfaceControl, WindowState* win);
+    int32_t resolveFormat(int32_t format);
 
     WindowTokenMap mTokenMap;
     WindowStateMap mWindowMap;
+    // windows with a vsync request, linked through WindowState::VsyncLink
+    WindowState* mVsyncRequesters;
     RootContainer* mContainer;
     std::shared_ptr<::os::app::UvLoop> mUvLooper;
     InputMonitorMap mInputMonitorMap;
@@ -110,6 +123,7 @@ private:
     WindowAnimEngine* mWinAnimEngine;
 #endif
     GestureDetector mGestureDetector;
+    SurfaceBufferPool mBufferPool;
 };
 
 } // namespace wm
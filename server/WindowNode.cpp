@@ -19,6 +19,7 @@
 #include "WindowNode.h"
 
 #include "../common/WindowUtils.h"
+#include "wm/LayerState.h"
 #include "wm/LayoutParams.h"
 
 namespace os {
@@ -116,8 +117,8 @@ WindowNode::WindowNode(WindowState* state, void* parent, const Rect& rect, bool
     mWidget = lv_mainwnd_create((lv_obj_t*)parent);
     lv_obj_add_flag(mWidget, LV_OBJ_FLAG_HIDDEN);
 
-    mColorFormat = getLvColorFormatType(format);
     lv_mainwnd_update_flag(mWidget, LV_MAINWND_FLAG_DRAW_SCALE, true);
+    setColorFormat(format);
     setRect(rect);
 
     // init window meta information
@@ -133,29 +134,30 @@ void WindowNode::resetOpaque() {
     lv_obj_set_style_opa(mWidget, 0xFF, LV_PART_MAIN);
 }
 
-bool WindowNode::updateBuffer(BufferItem* item, Rect* rect, uint32_t seq) {
+bool WindowNode::updateBuffer(BufferItem* item, const Rect* rects, uint32_t count, uint32_t seq) {
     WM_PROFILER_BEGIN();
 
     bool result = false;
-    lv_area_t area;
+    lv_area_t areas[LAYER_STATE_MAX_DAMAGE];
     lv_mainwnd_buf_dsc_t dsc;
     BufferItem* oldBuffer = mBuffer;
 
     mBuffer = item;
-    if (rect) {
-        area.x1 = rect->left;
-        area.y1 = rect->top;
-        area.y2 = rect->bottom;
-        area.x2 = rect->right;
+    if (!rects || count > LAYER_STATE_MAX_DAMAGE) count = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        areas[i].x1 = rects[i].left;
+        areas[i].y1 = rects[i].top;
+        areas[i].y2 = rects[i].bottom;
+        areas[i].x2 = rects[i].right;
     }
 
     if (mBuffer) {
         initBufDsc(&dsc, mBuffer->mKey, mRect.getWidth(), mRect.getHeight(), getColorFormat(),
                    mBuffer->mSize, mBuffer->mBuffer);
         dsc.seq = seq;
-        result = lv_mainwnd_update_buffer(mWidget, &dsc, rect ? &area : nullptr);
+        result = lv_mainwnd_update_buffer(mWidget, &dsc, count ? areas : nullptr, count);
     } else {
-        result = lv_mainwnd_update_buffer(mWidget, NULL, NULL);
+        result = lv_mainwnd_update_buffer(mWidget, NULL, NULL, 0);
     }
 
     FLOGD("(%p) %s from(0x%0" PRIx32 ") to(0x%0" PRIx32 ") seq=%" PRIu32 "\n", this,
@@ -223,6 +225,29 @@ void WindowNode::setRect(const Rect& newRect) {
     mRect = newRect;
 }
 
+void WindowNode::setPosition(int32_t x, int32_t y) {
+    if (x == mRect.getLeft() && y == mRect.getTop()) {
+        return;
+    }
+
+    /* only moves the widget, the buffer content is reused as is */
+    Rect rect(x, y, x + mRect.getWidth(), y + mRect.getHeight());
+    if (mWidget) {
+        lv_obj_set_pos(mWidget, x, y);
+    }
+    mRect = rect;
+}
+
+void WindowNode::setAlpha(int32_t alpha) {
+    if (mWidget) {
+        lv_obj_set_style_opa(mWidget, DATA_CLAMP(alpha, LV_OPA_TRANSP, LV_OPA_COVER), LV_PART_MAIN);
+    }
+}
+
+bool WindowNode::isOccluded() {
+    return mWidget ? lv_mainwnd_is_occluded(mWidget) : false;
+}
+
 void WindowNode::setParent(void* parent) {
     FLOGI("update node parent");
     if (mWidget) {
@@ -230,9 +255,19 @@ void WindowNode::setParent(void* parent) {
     }
 }
 
+void WindowNode::setColorFormat(int32_t format) {
+    mColorFormat = getLvColorFormatType(format);
+    lv_mainwnd_update_flag(mWidget, LV_MAINWND_FLAG_OPAQUE,
+                           mColorFormat == LV_COLOR_FORMAT_RGB565 ||
+                                   mColorFormat == LV_COLOR_FORMAT_RGB888 ||
+                                   mColorFormat == LV_COLOR_FORMAT_XRGB8888);
+}
+
 uint32_t WindowNode::getSurfaceSize() {
-    int bpp = lv_color_format_get_bpp(mColorFormat);
-    return mRect.getWidth() * mRect.getHeight() * (bpp >> 3);
+    uint32_t pixels = mRect.getWidth() * mRect.getHeight();
+    /* the alpha plane follows the color plane */
+    if (mColorFormat == LV_COLOR_FORMAT_RGB565A8) return pixels * 3;
+    return pixels * (lv_color_format_get_bpp(mColorFormat) >> 3);
 }
 
 } // namespace wm
@@ -30,7 +30,7 @@ public:
                int32_t format);
     ~WindowNode();
 
-    bool updateBuffer(BufferItem* item, Rect* rect, uint32_t seq);
+    bool updateBuffer(BufferItem* item, const Rect* rects, uint32_t count, uint32_t seq);
 
     BufferItem* acquireBuffer();
     bool releaseBuffer();
@@ -54,8 +54,12 @@ public:
     void enableInput(bool enable);
 
     void setRect(const Rect& newRect);
+    void setPosition(int32_t x, int32_t y);
+    void setAlpha(int32_t alpha);
     void setParent(void* parent);
+    void setColorFormat(int32_t format);
     void resetOpaque();
+    bool isOccluded();
 
     uint32_t getSurfaceSize();
 
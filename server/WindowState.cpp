@@ -49,13 +49,19 @@ static inline void* getLayerByType(WindowManagerService* service, int type) {
 
 WindowState::WindowState(WindowManagerService* service, const sp<IWindow>& window,
                          std::shared_ptr<WindowToken> token, const LayoutParams& params,
-                         int32_t visibility, bool enableInput)
+                         int32_t visibility, bool enableInput, int32_t pid)
       : mClient(window),
+        mClientPid(pid),
         mToken(token),
         mService(service),
         mInputDispatcher(nullptr),
+        mHasPendingState(false),
         mVsyncRequest(VsyncRequest::VSYNC_REQ_NONE),
+        mVsyncLink({nullptr, nullptr, false}),
         mFrameReq(0),
+        mVsyncCount(0),
+        mVsyncDeferred(false),
+        mLastFrameTime(0),
         mHasSurface(false),
         mFlags(0),
         mNeedInput(enableInput) {
@@ -75,6 +81,7 @@ WindowState::WindowState(WindowManagerService* service, const sp<IWindow>& windo
 
 WindowState::~WindowState() {
     FLOGI("%p", this);
+    if (mVsyncLink.mLinked) mService->removeVsyncRequester(this);
     mClient = nullptr;
     if (mNode) delete mNode;
 #ifdef CONFIG_ENABLE_TRANSITION_ANIMATION
@@ -147,6 +154,8 @@ void WindowState::sendAppVisibilityToClients(int32_t visibility) {
         scheduleVsync(mVsyncRequest != VsyncRequest::VSYNC_REQ_NONE
                               ? mVsyncRequest
                               : VsyncRequest::VSYNC_REQ_SINGLE);
+        /* a request kept while hidden resumes with the window */
+        mService->rearmVsync();
         mClient->dispatchAppVisibility(visible);
     }
     WM_PROFILER_END();
@@ -169,7 +178,10 @@ void WindowState::onAnimationFinished(WindowAnimStatus status) {
 #endif
 
 std::shared_ptr<SurfaceControl> WindowState::createSurfaceControl(const std::vector<BufferId>& ids,
-                                                                  const std::string& fmqName) {
+                                                                  const std::string& fmqName,
+                                                                  const std::string& stateName,
+                                                                  const std::string& transName,
+                                                                  const std::string& vsyncName) {
     WM_PROFILER_BEGIN();
 
     destroySurfaceControl();
@@ -180,9 +192,20 @@ std::shared_ptr<SurfaceControl> WindowState::createSurfaceControl(const std::vec
             std::make_shared<SurfaceControl>(IInterface::asBinder(mClient), handle, mAttrs.mWidth,
                                              mAttrs.mHeight, mAttrs.mFormat, getSurfaceSize());
     mSurfaceControl->getFMQ().setName(fmqName);
+    mSurfaceControl->getBufferState()->setName(stateName);
+    mSurfaceControl->getTransactionFMQ().setName(transName);
+    mSurfaceControl->getVsyncFMQ().setName(vsyncName);
     mSurfaceControl->initBufferIds(ids);
     initSurfaceBuffer(mSurfaceControl, true);
 
+    /* client posts its layer states to the transaction channel and signals us */
+    auto& transFmq = mSurfaceControl->getTransactionFMQ();
+    if (transFmq.getEventFd() >= 0) {
+        transFmq.armNotify();
+        mTransactionMonitor.start(mService->getUvLoop(), transFmq.getEventFd(),
+                                  [this]() { drainTransactions(); });
+    }
+
     std::shared_ptr<BufferConsumer> buffConsumer =
             std::make_shared<BufferConsumer>(mSurfaceControl);
     mSurfaceControl->setBufferQueue(buffConsumer);
@@ -199,26 +222,97 @@ void WindowState::destroySurfaceControl() {
         setHasSurface(false);
         if (mNode != nullptr) {
             FLOGI("updateBuffer NULLPTR");
-            mNode->updateBuffer(nullptr, nullptr, 0);
+            mNode->updateBuffer(nullptr, nullptr, 0, 0);
 #ifdef CONFIG_ENABLE_TRANSITION_ANIMATION
             mFrameWaiting = true;
 #endif
         }
-        uninitSurfaceBuffer(mSurfaceControl);
+        mTransactionMonitor.stop();
+        mHasPendingState = false;
+        if (IInterface::asBinder(mClient)->isBinderAlive()) {
+            mService->recycleSurfaceBuffers(mClientPid, mSurfaceControl);
+        } else {
+            uninitSurfaceBuffer(mSurfaceControl, true);
+        }
         mSurfaceControl.reset();
     }
 }
 
+void WindowState::drainTransactions() {
+    if (mSurfaceControl.get() == nullptr) {
+        return;
+    }
+
+    WM_PROFILER_BEGIN();
+    auto& fmq = mSurfaceControl->getTransactionFMQ();
+    fmq.clearNotify();
+
+    LayerStateRecord record;
+    LayerState layerState;
+    /* one ring's worth per wakeup, a client that keeps writing can't hold the loop */
+    uint32_t budget = fmq.capacity();
+    while (budget > 0 && fmq.read(&record)) {
+        layerState.fromRecord(record);
+        queueTransaction(layerState);
+        budget--;
+    }
+    fmq.armNotify();
+    /* left over or landed before arming, come back on the next loop iteration */
+    if (fmq.size() > 0) fmq.notify();
+    WM_PROFILER_END();
+}
+
+void WindowState::queueTransaction(const LayerState& layerState) {
+    if (!mHasPendingState) {
+        mPendingState = layerState;
+        mHasPendingState = true;
+    } else {
+        /* the pending buffer will never be shown, give it back now */
+        if ((mPendingState.mFlags & LayerState::LAYER_BUFFER_CHANGED) &&
+            (layerState.mFlags & LayerState::LAYER_BUFFER_CHANGED) &&
+            mPendingState.mBufferKey != layerState.mBufferKey) {
+            std::shared_ptr<BufferConsumer> consumer = getBufferConsumer();
+            BufferItem* item =
+                    consumer ? consumer->syncQueuedState(mPendingState.mBufferKey) : nullptr;
+            if (item) releaseBuffer(item);
+        }
+        LayerState state = layerState;
+        mPendingState.merge(state);
+    }
+
+    mService->getRootContainer()->requestRefresh();
+}
+
+bool WindowState::latchTransaction() {
+    if (!mHasPendingState) {
+        return false;
+    }
+
+    mHasPendingState = false;
+    applyTransaction(mPendingState);
+    return true;
+}
+
 void WindowState::applyTransaction(LayerState layerState) {
     FLOGD("%p [%d] seq=%" PRIu32 "", this, mToken->getClientPid(), layerState.mSeq);
     WM_PROFILER_BEGIN();
 
     BufferItem* buffItem = nullptr;
-    Rect* rect = nullptr;
+    const Rect* rects = nullptr;
+    uint32_t rectCount = 0;
     if (layerState.mFlags & LayerState::LAYER_POSITION_CHANGED) {
+        mAttrs.mX = layerState.mX;
+        mAttrs.mY = layerState.mY;
+        mNode->setPosition(layerState.mX, layerState.mY);
     }
 
     if (layerState.mFlags & LayerState::LAYER_ALPHA_CHANGED) {
+        mNode->setAlpha(layerState.mAlpha);
+    }
+
+    if (!(layerState.mFlags & LayerState::LAYER_BUFFER_CHANGED)) {
+        WM_PROFILER_END();
+        return;
     }
 
     if (layerState.mFlags & LayerState::LAYER_BUFFER_CHANGED) {
@@ -231,7 +325,13 @@ void WindowState::applyTransaction(LayerState layerState) {
     }
 
     if (layerState.mFlags & LayerState::LAYER_BUFFER_CROP_CHANGED) {
-        rect = &layerState.mBufferCrop;
+        if (layerState.mDamageCount > 0) {
+            rects = layerState.mDamage;
+            rectCount = layerState.mDamageCount;
+        } else {
+            rects = &layerState.mBufferCrop;
+            rectCount = 1;
+        }
     }
 #ifdef CONFIG_ENABLE_TRANSITION_ANIMATION
     if (mFrameWaiting &&
@@ -256,24 +356,29 @@ void WindowState::applyTransaction(LayerState layerState) {
 
 #endif
 
-    mNode->updateBuffer(buffItem, rect, layerState.mSeq);
+    mNode->updateBuffer(buffItem, rects, rectCount, layerState.mSeq);
     WM_PROFILER_END();
 }
 
 bool WindowState::scheduleVsync(VsyncRequest vsyncReq) {
-    mService->getRootContainer()->enableVsync(true);
-
     if (mVsyncRequest == vsyncReq) {
         return false;
     }
 
+    if (vsyncReq != VsyncRequest::VSYNC_REQ_NONE) {
+        mService->addVsyncRequester(this);
+    } else {
+        mService->removeVsyncRequester(this);
+    }
+
     /* observer for animation */
-    if (vsyncReq == VsyncRequest::VSYNC_REQ_PERIODIC ||
-        mVsyncRequest == VsyncRequest::VSYNC_REQ_PERIODIC)
+    if (isPeriodicVsync(vsyncReq) || isPeriodicVsync(mVsyncRequest))
         FLOGW("%p [%d] request vreq=%s", this, mToken->getClientPid(),
               VsyncRequestToString(vsyncReq));
 
     mVsyncRequest = vsyncReq;
+    mVsyncCount = 0;
+    if (vsyncReq == VsyncRequest::VSYNC_REQ_NONE) mVsyncDeferred = false;
 
     return true;
 }
@@ -282,10 +387,61 @@ VsyncRequest WindowState::onVsync() {
     if (mVsyncRequest == VsyncRequest::VSYNC_REQ_NONE) {
         return mVsyncRequest;
     }
+    /* reduced rate, this refresh belongs to other windows */
+    uint32_t divisor = vsyncRateDivisor(mVsyncRequest);
+    if (divisor > 1 && (mVsyncCount++ % divisor) != 0) {
+        return mVsyncRequest;
+    }
+
+    /* one frame per period, a deferred one sent on buffer release serves this refresh */
+    if (curSysTimeUs() - mLastFrameTime < LV_DEF_REFR_PERIOD * 1000 / 2) {
+        return mVsyncRequest;
+    }
+
+    /* the client couldn't dequeue, wait for releaseBuffer */
+    if (!hasFreeBuffer()) {
+        if (!mVsyncDeferred)
+            FLOGD("%p [%d] no free buffer, defer vsync", this, mToken->getClientPid());
+        mVsyncDeferred = true;
+        return mVsyncRequest;
+    }
+
+    dispatchFrame();
+    return mVsyncRequest;
+}
+
+bool WindowState::hasFreeBuffer() {
+    std::shared_ptr<BufferConsumer> consumer = getBufferConsumer();
+    if (consumer == nullptr) {
+        /* the client relayouts on frame to get its surface */
+        return true;
+    }
+
+    /* the pending buffer is only synced to queued when latched */
+    uint32_t freeCount = consumer->freeCount();
+    if (mHasPendingState && (mPendingState.mFlags & LayerState::LAYER_BUFFER_CHANGED) &&
+        freeCount > 0) {
+        freeCount--;
+    }
+    return freeCount > 0;
+}
+
+void WindowState::dispatchFrame() {
     WM_PROFILER_BEGIN();
 
+    mVsyncDeferred = false;
     mVsyncRequest = nextVsyncState(mVsyncRequest);
-    mClient->onFrame(++mFrameReq);
+    if (mVsyncRequest == VsyncRequest::VSYNC_REQ_NONE) mService->removeVsyncRequester(this);
+
+    /* a buffer queued before the next refresh is presented one period later */
+    uint64_t now = curSysTimeUs();
+    uint64_t period = LV_DEF_REFR_PERIOD * 1000;
+    uint64_t deadline = now + mService->getRootContainer()->vsyncLatchDelay() * 1000;
+    VsyncEvent event = {++mFrameReq, LV_DEF_REFR_PERIOD, now, deadline, deadline + period};
+    mLastFrameTime = now;
+    if (!postVsyncEvent(event)) {
+        mClient->onFrame(event.mSeq, event.mTimestamp, event.mDeadline, event.mPresentTime);
+    }
 
     FLOGI("%p [%d] vreq=%s send vsync(seq=%" PRIu32 ") to client!", this, mToken->getClientPid(),
           VsyncRequestToString(mVsyncRequest), mFrameReq);
@@ -293,8 +449,24 @@ VsyncRequest WindowState::onVsync() {
     if (mFrameReq == UINT32_MAX) mFrameReq = 0;
 
     WM_PROFILER_END();
+}
 
-    return mVsyncRequest;
+bool WindowState::postVsyncEvent(const VsyncEvent& event) {
+    if (mSurfaceControl.get() == nullptr) {
+        return false;
+    }
+
+    auto& fmq = mSurfaceControl->getVsyncFMQ();
+    if (fmq.getEventFd() < 0) {
+        return false;
+    }
+
+    if (!fmq.write(&event)) {
+        return false;
+    }
+
+    fmq.notify();
+    return true;
 }
 
 void WindowState::removeIfPossible() {
@@ -342,6 +514,14 @@ bool WindowState::releaseBuffer(BufferItem* buffer) {
     }
 
     if (consumer && consumer->releaseBuffer(buffer) && mClient) {
+        /* client picks the free state up from shared memory */
+        if (consumer->hasSharedState()) {
+            FLOGD("%p success to relase bufKey=%" PRId32 "", this, buffer->mKey);
+            mSurfaceControl->getFMQ().notify();
+            if (mVsyncDeferred) dispatchFrame();
+            return true;
+        }
+
         WM_PROFILER_BEGIN();
 
         if (!mSurfaceControl->getFMQ().write(&(buffer->mKey))) {
@@ -350,19 +530,33 @@ bool WindowState::releaseBuffer(BufferItem* buffer) {
             mClient->bufferReleased(buffer->mKey);
         } else {
             FLOGD("%p success to relase bufKey=%" PRId32 "", this, buffer->mKey);
+            mSurfaceControl->getFMQ().notify();
         }
         WM_PROFILER_END();
+
+        if (mVsyncDeferred) dispatchFrame();
         return true;
     }
     return false;
 }
 
+bool WindowState::canReuseSurface(const LayoutParams& attrs) {
+    if (mSurfaceControl == nullptr || !mSurfaceControl->isValid()) {
+        return false;
+    }
+
+    return mSurfaceControl->getWidth() == (uint32_t)attrs.mWidth &&
+            mSurfaceControl->getHeight() == (uint32_t)attrs.mHeight &&
+            mSurfaceControl->getFormat() == (uint32_t)attrs.mFormat;
+}
+
 void WindowState::setLayoutParams(LayoutParams attrs) {
-    if (mSurfaceControl != nullptr && mSurfaceControl->isValid()) {
+    if (mSurfaceControl != nullptr && mSurfaceControl->isValid() && !canReuseSurface(attrs)) {
         FLOGW("%p shouldn't update layout configuration when surface is valid!", this);
         return;
     }
 
+    if (attrs.mFormat != mAttrs.mFormat) mNode->setColorFormat(attrs.mFormat);
     mAttrs = attrs;
     Rect rect(attrs.mX, attrs.mY, attrs.mX + attrs.mWidth, attrs.mY + attrs.mHeight);
     mNode->setRect(rect);
@@ -376,5 +570,9 @@ bool WindowState::isVisible() {
     return mVisibility != LayoutParams::WINDOW_GONE ? true : false;
 }
 
+bool WindowState::isOccluded() {
+    return mNode ? mNode->isOccluded() : false;
+}
+
 } // namespace wm
 } // namespace os
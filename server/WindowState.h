@@ -21,6 +21,7 @@
 #include <binder/Status.h>
 #include <utils/RefBase.h>
 
+#include "../common/FmqMonitor.h"
 #include "InputDispatcher.h"
 #include "WindowConfig.h"
 #include "WindowManagerService.h"
@@ -48,9 +49,10 @@ public:
     ~WindowState();
     WindowState(WindowManagerService* service, const sp<IWindow>& window,
                 shared_ptr<WindowToken> token, const LayoutParams& params, int32_t visibility,
-                bool enableInput);
+                bool enableInput, int32_t pid);
 
     bool isVisible();
+    bool isOccluded();
     void sendAppVisibilityToClients(int32_t visibility);
     void setVisibility(int32_t visibility);
     void removeIfPossible();
@@ -58,19 +60,32 @@ public:
 
     std::shared_ptr<InputDispatcher> createInputDispatcher(const std::string& name);
     std::shared_ptr<SurfaceControl> createSurfaceControl(const std::vector<BufferId>& ids,
-                                                         const std::string& fmqName);
+                                                         const std::string& fmqName,
+                                                         const std::string& stateName,
+                                                         const std::string& transName,
+                                                         const std::string& vsyncName);
     std::shared_ptr<BufferConsumer> getBufferConsumer();
     void destroySurfaceControl();
 
     void applyTransaction(LayerState layerState);
+    void queueTransaction(const LayerState& layerState);
+    bool latchTransaction();
+    void drainTransactions();
     bool scheduleVsync(VsyncRequest vsyncReq);
     VsyncRequest onVsync();
+    bool hasFreeBuffer();
+    bool postVsyncEvent(const VsyncEvent& event);
+    void dispatchFrame();
     bool sendInputMessage(const InputMessage* ie);
 
     std::shared_ptr<WindowToken> getToken() {
         return mToken;
     }
 
+    int32_t getClientPid() {
+        return mClientPid;
+    }
+
     sp<IWindow>& getClient() {
         return mClient;
     }
@@ -83,8 +98,28 @@ public:
     bool releaseBuffer(BufferItem* buffer);
 
     void setLayoutParams(LayoutParams attrs);
+    const LayoutParams& getLayoutParams() {
+        return mAttrs;
+    }
+
+    std::shared_ptr<SurfaceControl> getSurfaceControl() {
+        return mSurfaceControl;
+    }
+
+    bool canReuseSurface(const LayoutParams& attrs);
     uint32_t getSurfaceSize();
 
+    /* intrusive links of the vsync requester list in WindowManagerService */
+    typedef struct {
+        WindowState* mPrev;
+        WindowState* mNext;
+        bool mLinked;
+    } VsyncLink;
+
+    VsyncLink& vsyncLink() {
+        return mVsyncLink;
+    }
+
 #ifdef CONFIG_ENABLE_TRANSITION_ANIMATION
     void onAnimationFinished(WindowAnimStatus status);
 #endif
@@ -93,13 +128,22 @@ public:
 
 private:
     sp<IWindow> mClient;
+    int32_t mClientPid;
     std::shared_ptr<WindowToken> mToken;
     WindowManagerService* mService;
     std::shared_ptr<SurfaceControl> mSurfaceControl;
     std::shared_ptr<InputDispatcher> mInputDispatcher;
+    FmqMonitor mTransactionMonitor;
+    LayerState mPendingState;
+    bool mHasPendingState;
     LayoutParams mAttrs;
     VsyncRequest mVsyncRequest;
+    VsyncLink mVsyncLink;
     uint32_t mFrameReq;
+    uint32_t mVsyncCount;
+    // frame held back until the compositor releases a buffer
+    bool mVsyncDeferred;
+    uint64_t mLastFrameTime;
     int32_t mVisibility;
     bool mHasSurface;
 #ifdef CONFIG_ENABLE_TRANSITION_ANIMATION
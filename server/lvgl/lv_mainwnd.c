@@ -26,6 +26,7 @@
 #include "lv_mainwnd.h"
 
 #include "../common/WindowTrace.h"
+#include "lv_mainwnd_blit.h"
 
 /*********************
  *      DEFINES
@@ -72,6 +73,114 @@ static inline void reset_buf_dsc(lv_obj_t* obj) {
     mainwnd->buf_dsc.img_dsc.header.h = 0;
 }
 
+/* the zoom draw_buffer paints the buffer with */
+static uint16_t get_draw_scale(lv_obj_t* obj) {
+    lv_mainwnd_t* mainwnd = (lv_mainwnd_t*)obj;
+    uint16_t zoom = LV_ZOOM_NONE;
+
+    if (mainwnd->flags & LV_MAINWND_FLAG_DRAW_SCALE) {
+        int32_t obj_w = lv_obj_get_width(obj);
+        zoom *= obj_w / mainwnd->buf_dsc.img_dsc.header.w;
+    }
+    return zoom == 0 ? 1 : zoom;
+}
+
+static bool get_opaque_area(lv_obj_t* obj, lv_area_t* area) {
+    if (!lv_obj_check_type(obj, MY_CLASS) || lv_obj_has_flag(obj, LV_OBJ_FLAG_HIDDEN)) {
+        return false;
+    }
+
+    lv_mainwnd_t* mainwnd = (lv_mainwnd_t*)obj;
+    if (!(mainwnd->flags & LV_MAINWND_FLAG_OPAQUE) || mainwnd->buf_dsc.id == INVALID_BUFID ||
+        !mainwnd->buf_dsc.img_dsc.data || mainwnd->buf_dsc.img_dsc.header.w == 0) {
+        return false;
+    }
+
+    /* a scaled buffer, e.g. the old one still latched after a resize, covers another area */
+    if (get_draw_scale(obj) != LV_SCALE_NONE) {
+        return false;
+    }
+
+    /* translucent or transformed (e.g. animating) windows hide nothing for sure */
+    if (lv_obj_get_style_opa_recursive(obj, LV_PART_MAIN) < LV_OPA_MAX ||
+        lv_obj_get_style_transform_scale_x(obj, LV_PART_MAIN) != LV_SCALE_NONE ||
+        lv_obj_get_style_transform_scale_y(obj, LV_PART_MAIN) != LV_SCALE_NONE ||
+        lv_obj_get_style_transform_rotation(obj, LV_PART_MAIN) != 0) {
+        return false;
+    }
+
+    lv_obj_get_coords(obj, area);
+    area->x2 = LV_MIN(area->x2, area->x1 + mainwnd->buf_dsc.img_dsc.header.w - 1);
+    area->y2 = LV_MIN(area->y2, area->y1 + mainwnd->buf_dsc.img_dsc.header.h - 1);
+    return true;
+}
+
+/* cut the part hidden by cover, true when nothing is left */
+static bool cut_covered_area(lv_area_t* area, const lv_area_t* cover) {
+    lv_area_t common;
+    if (!_lv_area_intersect(&common, area, cover)) return false;
+    if (_lv_area_is_in(area, cover, 0)) return true;
+
+    /* only a cover across a whole side leaves a rectangle */
+    if (cover->x1 <= area->x1 && cover->x2 >= area->x2) {
+        if (cover->y1 <= area->y1) {
+            area->y1 = cover->y2 + 1;
+        } else if (cover->y2 >= area->y2) {
+            area->y2 = cover->y1 - 1;
+        }
+    } else if (cover->y1 <= area->y1 && cover->y2 >= area->y2) {
+        if (cover->x1 <= area->x1) {
+            area->x1 = cover->x2 + 1;
+        } else if (cover->x2 >= area->x2) {
+            area->x2 = cover->x1 - 1;
+        }
+    }
+    return false;
+}
+
+static bool cut_by_children(lv_obj_t* parent, uint32_t from, lv_area_t* area) {
+    lv_area_t cover;
+    uint32_t count = lv_obj_get_child_count(parent);
+    for (uint32_t i = from; i < count; i++) {
+        if (get_opaque_area(lv_obj_get_child(parent, i), &cover) &&
+            cut_covered_area(area, &cover)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* clip area by the opaque windows drawn after obj, true when fully covered */
+static bool cull_occluded_area(lv_obj_t* obj, lv_area_t* area) {
+    lv_obj_t* parent = lv_obj_get_parent(obj);
+    if (!parent) return false;
+
+    if (cut_by_children(parent, lv_obj_get_index(obj) + 1, area)) return true;
+    if (lv_obj_has_flag(parent, LV_MAINWND_LAYER_FLAG_NO_UPPER_CULL)) return false;
+
+    /* the top and system layers are drawn over the active screen */
+    lv_display_t* disp = lv_obj_get_display(obj);
+    lv_obj_t* layers[] = {lv_display_get_layer_top(disp), lv_display_get_layer_sys(disp)};
+    lv_obj_t* screen = lv_obj_get_screen(obj);
+    uint32_t first = screen == layers[1] ? 2 : (screen == layers[0] ? 1 : 0);
+    for (uint32_t i = first; i < 2; i++) {
+        if (layers[i] && cut_by_children(layers[i], 0, area)) return true;
+    }
+    return false;
+}
+
+/* tell the parent what changed, NULL when the change may reach outside the window */
+static void send_damage(lv_obj_t* obj, const lv_area_t* area) {
+    lv_obj_t* parent = lv_obj_get_parent(obj);
+    if (parent) lv_obj_send_event(parent, lv_mainwnd_get_damage_event(), (void*)area);
+}
+
+static void send_window_damage(lv_obj_t* obj) {
+    lv_area_t coords;
+    lv_obj_get_coords(obj, &coords);
+    send_damage(obj, &coords);
+}
+
 static inline void reset_meta_info(lv_obj_t* obj) {
     LV_ASSERT_OBJ(obj, MY_CLASS);
 
@@ -98,13 +207,15 @@ lv_obj_t* lv_mainwnd_create(lv_obj_t* parent) {
     return obj;
 }
 
-bool lv_mainwnd_update_buffer(lv_obj_t* obj, lv_mainwnd_buf_dsc_t* buf_dsc, const lv_area_t* area) {
+bool lv_mainwnd_update_buffer(lv_obj_t* obj, lv_mainwnd_buf_dsc_t* buf_dsc,
+                              const lv_area_t* areas, uint32_t count) {
     LV_ASSERT_OBJ(obj, MY_CLASS);
     WM_PROFILER_BEGIN();
 
     if (!buf_dsc) {
         lv_obj_add_flag(obj, LV_OBJ_FLAG_HIDDEN);
         reset_buf_dsc(obj);
+        send_window_damage(obj);
         WM_PROFILER_END();
         return true;
     }
@@ -129,8 +240,9 @@ bool lv_mainwnd_update_buffer(lv_obj_t* obj, lv_mainwnd_buf_dsc_t* buf_dsc, cons
     mainwnd->buf_dsc.img_dsc.header.w = buf_dsc->img_dsc.header.w;
     mainwnd->buf_dsc.img_dsc.header.h = buf_dsc->img_dsc.header.h;
 
-    if (!area) {
+    if (!areas || count == 0) {
         lv_obj_invalidate(obj);
+        send_window_damage(obj);
         WM_PROFILER_END();
         return true;
     }
@@ -138,12 +250,17 @@ bool lv_mainwnd_update_buffer(lv_obj_t* obj, lv_mainwnd_buf_dsc_t* buf_dsc, cons
     lv_area_t win_coords;
     lv_obj_get_coords(obj, &win_coords);
 
-    if (win_coords.x1 != 0 || win_coords.y1 != 0)
-        lv_area_move((lv_area_t*)area, win_coords.x1, win_coords.y1);
+    /* invalidate every damaged rect on its own, the display joins them if worth it */
+    for (uint32_t i = 0; i < count; i++) {
+        lv_area_t area = areas[i];
+        if (win_coords.x1 != 0 || win_coords.y1 != 0)
+            lv_area_move(&area, win_coords.x1, win_coords.y1);
 
-    lv_area_t inv_area;
-    if (_lv_area_intersect(&inv_area, &win_coords, area)) {
-        lv_obj_invalidate_area(obj, &inv_area);
+        lv_area_t inv_area;
+        if (_lv_area_intersect(&inv_area, &win_coords, &area)) {
+            lv_obj_invalidate_area(obj, &inv_area);
+            send_damage(obj, &inv_area);
+        }
     }
     WM_PROFILER_END();
     return true;
@@ -163,6 +280,38 @@ void lv_mainwnd_update_flag(lv_obj_t* obj, lv_mainwnd_flag_e flag, bool bAdd) {
     WM_PROFILER_END();
 }
 
+lv_event_code_t lv_mainwnd_get_damage_event(void) {
+    static lv_event_code_t damage_event = LV_EVENT_ALL;
+    if (damage_event == LV_EVENT_ALL) damage_event = (lv_event_code_t)lv_event_register_id();
+    return damage_event;
+}
+
+bool lv_mainwnd_is_occluded(lv_obj_t* obj) {
+    LV_ASSERT_OBJ(obj, MY_CLASS);
+
+    lv_area_t coords;
+    lv_obj_get_coords(obj, &coords);
+    return cull_occluded_area(obj, &coords);
+}
+
+const lv_mainwnd_buf_dsc_t* lv_mainwnd_get_scanout_buffer(lv_obj_t* obj, lv_color_format_t cf) {
+    LV_ASSERT_OBJ(obj, MY_CLASS);
+
+    lv_mainwnd_t* mainwnd = (lv_mainwnd_t*)obj;
+    lv_area_t area;
+    if (!get_opaque_area(obj, &area) || mainwnd->buf_dsc.img_dsc.header.cf != cf) return NULL;
+
+    lv_display_t* disp = lv_obj_get_display(obj);
+    int32_t hor_res = lv_display_get_horizontal_resolution(disp);
+    int32_t ver_res = lv_display_get_vertical_resolution(disp);
+    if (area.x1 != 0 || area.y1 != 0 || mainwnd->buf_dsc.img_dsc.header.w != hor_res ||
+        mainwnd->buf_dsc.img_dsc.header.h != ver_res || lv_obj_get_width(obj) != hor_res ||
+        lv_obj_get_height(obj) != ver_res) {
+        return NULL;
+    }
+    return &mainwnd->buf_dsc;
+}
+
 /*=====================
  * Setter functions
  *====================*/
@@ -211,26 +360,100 @@ static void lv_mainwnd_destructor(const lv_obj_class_t* class_p, lv_obj_t* obj)
     }
 }
 
+#ifdef CONFIG_SYSTEM_WINDOW_FAST_BLIT
+static lv_mainwnd_blit_op_t get_blit_op(lv_color_format_t src_cf, lv_color_format_t dst_cf) {
+    if (dst_cf == LV_COLOR_FORMAT_RGB565) {
+        if (src_cf == LV_COLOR_FORMAT_ARGB8888) return LV_MAINWND_BLIT_ARGB8888_OVER_RGB565;
+        if (src_cf == LV_COLOR_FORMAT_RGB565) return LV_MAINWND_BLIT_RGB565_COPY;
+        if (src_cf == LV_COLOR_FORMAT_RGB565A8) return LV_MAINWND_BLIT_RGB565A8_OVER_RGB565;
+    } else if (dst_cf == LV_COLOR_FORMAT_XRGB8888 && src_cf == LV_COLOR_FORMAT_ARGB8888) {
+        return LV_MAINWND_BLIT_ARGB8888_OVER_XRGB8888;
+    }
+    return LV_MAINWND_BLIT_NONE;
+}
+
+/* blit an untransformed window straight into the layer, false leaves it to lv_draw_image */
+static bool fast_blit(lv_layer_t* layer, const lv_draw_image_dsc_t* img_dsc,
+                      const lv_area_t* win_coords, const lv_area_t* clip_area) {
+    const lv_image_dsc_t* src = (const lv_image_dsc_t*)img_dsc->src;
+    lv_draw_buf_t* draw_buf = layer->draw_buf;
+
+    if (img_dsc->scale_x != LV_SCALE_NONE || img_dsc->scale_y != LV_SCALE_NONE ||
+        img_dsc->rotation != 0)
+        return false;
+    if (img_dsc->opa < LV_OPA_MAX || img_dsc->recolor_opa > LV_OPA_MIN ||
+        img_dsc->blend_mode != LV_BLEND_MODE_NORMAL)
+        return false;
+    if (!draw_buf || !draw_buf->data) return false;
+
+    lv_mainwnd_blit_op_t op = get_blit_op(src->header.cf, layer->color_format);
+    if (op == LV_MAINWND_BLIT_NONE) return false;
+
+    int32_t src_stride = src->header.stride;
+    if (src_stride == 0) src_stride = lv_draw_buf_width_to_stride(src->header.w, src->header.cf);
+    uint32_t src_size = src_stride * src->header.h;
+    if (op == LV_MAINWND_BLIT_RGB565A8_OVER_RGB565) src_size += src_stride / 2 * src->header.h;
+    if (src->data_size < src_size) return false;
+
+    lv_area_t area;
+    if (!_lv_area_intersect(&area, clip_area, win_coords) ||
+        !_lv_area_intersect(&area, &area, &layer->buf_area))
+        return true;
+
+    /* what is already queued on the layer lies below the window, let it land first */
+    while (layer->draw_task_head) {
+        lv_draw_dispatch_wait_for_request();
+        lv_draw_dispatch();
+    }
+
+    int32_t src_x = area.x1 - win_coords->x1;
+    int32_t src_y = area.y1 - win_coords->y1;
+    int32_t src_bpp = src->header.cf == LV_COLOR_FORMAT_ARGB8888 ? 4 : 2;
+    int32_t dst_bpp = lv_color_format_get_size(layer->color_format);
+
+    lv_mainwnd_blit_dsc_t dsc;
+    dsc.src = src->data + src_y * src_stride + src_x * src_bpp;
+    dsc.src_stride = src_stride;
+    dsc.dst = draw_buf->data + (area.y1 - layer->buf_area.y1) * draw_buf->header.stride +
+            (area.x1 - layer->buf_area.x1) * dst_bpp;
+    dsc.dst_stride = draw_buf->header.stride;
+    dsc.alpha = NULL;
+    dsc.alpha_stride = 0;
+    if (op == LV_MAINWND_BLIT_RGB565A8_OVER_RGB565) {
+        dsc.alpha_stride = src_stride / 2;
+        dsc.alpha = src->data + src_stride * src->header.h + src_y * dsc.alpha_stride + src_x;
+    }
+    dsc.w = lv_area_get_width(&area);
+    dsc.h = lv_area_get_height(&area);
+
+    WM_PROFILER_BEGIN();
+#if defined(CONFIG_SYSTEM_WINDOW_BLIT_WORKERS) && CONFIG_SYSTEM_WINDOW_BLIT_WORKERS > 0
+    /* window buffers are only read and bands never share a row, done before return */
+    lv_mainwnd_blit_parallel(op, &dsc);
+#else
+    lv_mainwnd_blit(op, &dsc);
+#endif
+    WM_PROFILER_END();
+    return true;
+}
+#endif
+
 static inline void draw_buffer(lv_obj_t* obj, lv_event_t* e) {
     lv_layer_t* layer = lv_event_get_layer(e);
     lv_mainwnd_t* mainwnd = (lv_mainwnd_t*)obj;
 
     if (!mainwnd->buf_dsc.img_dsc.data) return;
     if (mainwnd->buf_dsc.img_dsc.header.w == 0 || mainwnd->buf_dsc.img_dsc.header.h == 0) return;
+    if (mainwnd->flags & LV_MAINWND_FLAG_SKIP_DRAW) return;
 
     lv_draw_image_dsc_t img_dsc;
     lv_draw_image_dsc_init(&img_dsc);
     lv_obj_init_draw_image_dsc(obj, LV_PART_MAIN, &img_dsc);
-    uint16_t zoom = LV_ZOOM_NONE;
 
     int32_t img_w = mainwnd->buf_dsc.img_dsc.header.w;
     int32_t img_h = mainwnd->buf_dsc.img_dsc.header.h;
 
-    if (mainwnd->flags & LV_MAINWND_FLAG_DRAW_SCALE) {
-        int32_t obj_w = lv_obj_get_width(obj);
-        zoom *= obj_w / img_w;
-    }
-    img_dsc.scale_x = zoom == 0 ? 1 : zoom;
+    img_dsc.scale_x = get_draw_scale(obj);
     img_dsc.scale_y = img_dsc.scale_x;
     img_dsc.rotation = 0;
     img_dsc.pivot.x = img_w / 2;
@@ -246,10 +469,26 @@ static inline void draw_buffer(lv_obj_t* obj, lv_event_t* e) {
     win_coords.y1 = coords.y1;
     win_coords.y2 = win_coords.y1 + img_h - 1;
 
+    /* skip what opaque windows above will paint over anyway */
+    lv_area_t clip_area;
+    if (!_lv_area_intersect(&clip_area, &layer->_clip_area, &coords)) return;
+    if (cull_occluded_area(obj, &clip_area)) {
+        LV_LOG_TRACE("mainwnd (%p) is occluded", mainwnd);
+        return;
+    }
+
     LV_LOG_INFO("draw (%p) with (%d) (%dx%d), buffer seq=%" PRIu32 "", mainwnd, mainwnd->buf_dsc.id,
                 img_w, img_h, mainwnd->buf_dsc.seq);
     img_dsc.src = &mainwnd->buf_dsc.img_dsc;
+
+#ifdef CONFIG_SYSTEM_WINDOW_FAST_BLIT
+    if (fast_blit(layer, &img_dsc, &win_coords, &clip_area)) return;
+#endif
+
+    const lv_area_t clip_area_ori = layer->_clip_area;
+    layer->_clip_area = clip_area;
     lv_draw_image(layer, &img_dsc, &win_coords);
+    layer->_clip_area = clip_area_ori;
 }
 
 static inline void dump_input_event(lv_mainwnd_input_event_t* ie) {
@@ -320,6 +559,12 @@ static void lv_mainwnd_event(const lv_obj_class_t* class_p, lv_event_t* e) {
     lv_mainwnd_t* mainwnd = (lv_mainwnd_t*)obj;
     lv_event_code_t code = lv_event_get_code(e);
     switch (code) {
+        case LV_EVENT_STYLE_CHANGED: {
+            /* opacity or transform, the window may draw outside its coords */
+            send_damage(obj, NULL);
+            break;
+        }
+
         case LV_EVENT_DRAW_MAIN: {
             if (mainwnd->buf_dsc.id != INVALID_BUFID) {
                 draw_buffer(obj, e);
@@ -44,6 +44,11 @@ enum {
     LV_MAINWND_EVENT_TYPE_POINTER = 1 << 2,
 };
 
+/**
+ * set on a layer whose composition is read back, its windows are then not
+ * culled by the top and system layers*/
+#define LV_MAINWND_LAYER_FLAG_NO_UPPER_CULL LV_OBJ_FLAG_USER_1
+
 /**********************
  *      TYPEDEFS
  **********************/
@@ -53,6 +58,10 @@ enum {
 typedef enum {
     LV_MAINWND_FLAG_DRAW_DEFALUT = 0,
     LV_MAINWND_FLAG_DRAW_SCALE = 1 << 1,
+    // buffer format has no alpha, the window hides what is below it
+    LV_MAINWND_FLAG_OPAQUE = 1 << 2,
+    // the buffer reaches the framebuffer without LVGL, drawing is skipped
+    LV_MAINWND_FLAG_SKIP_DRAW = 1 << 3,
 } lv_mainwnd_flag_e;
 
 typedef struct {
@@ -102,10 +111,20 @@ lv_obj_t* lv_mainwnd_create(lv_obj_t* parent);
  * Update buffer.
  * @param obj           pointer to a main window object
  * @param buf_dsc       pointer to the buffer descriptor
- * @param area          pointer to an area to update
+ * @param areas         pointer to the areas to update, NULL to update the whole window
+ * @param count         number of areas
  * @return true on success, false on failure
  */
-bool lv_mainwnd_update_buffer(lv_obj_t* obj, lv_mainwnd_buf_dsc_t* buf_dsc, const lv_area_t* area);
+bool lv_mainwnd_update_buffer(lv_obj_t* obj, lv_mainwnd_buf_dsc_t* buf_dsc,
+                              const lv_area_t* areas, uint32_t count);
+
+/**
+ * Get the event sent to the parent of a main window when its content changes.
+ * The parameter is the changed area in screen coordinates, or NULL when the
+ * change may reach outside the window (e.g. a new opacity or transform).
+ * @return the event code
+ */
+lv_event_code_t lv_mainwnd_get_damage_event(void);
 
 /**
  * Update flag.
@@ -115,6 +134,22 @@ bool lv_mainwnd_update_buffer(lv_obj_t* obj, lv_mainwnd_buf_dsc_t* buf_dsc, cons
  */
 void lv_mainwnd_update_flag(lv_obj_t* obj, lv_mainwnd_flag_e flag, bool bAdd);
 
+/**
+ * Check whether opaque windows above cover the whole window.
+ * @param obj           pointer to a main window object
+ * @return true if nothing of the window reaches the screen
+ */
+bool lv_mainwnd_is_occluded(lv_obj_t* obj);
+
+/**
+ * Get the buffer of a window which can be shown on the display as is.
+ * @param obj           pointer to a main window object
+ * @param cf            color format of the display
+ * @return the buffer descriptor, NULL unless the window covers the whole display
+ *         with an opaque, unscaled buffer of that color format
+ */
+const lv_mainwnd_buf_dsc_t* lv_mainwnd_get_scanout_buffer(lv_obj_t* obj, lv_color_format_t cf);
+
 /*=====================
  * Setter functions
  *====================*/
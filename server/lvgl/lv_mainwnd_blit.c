@@ -0,0 +1,403 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file lv_mainwnd_blit.c
+ *
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include "lv_mainwnd_blit.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define BLIT_USE_NEON 1
+#endif
+
+/*********************
+ *      DEFINES
+ *********************/
+
+/* pixels per vector step, also the minimum row length worth vectorizing */
+#define NEON_STEP 8
+
+/* helper threads at most, and the fewest rows worth handing to one */
+#define MAX_WORKERS 7
+#define MIN_BAND_ROWS 16
+
+#define LV_MAINWND_BLIT_MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+typedef void (*blit_row_cb_t)(uint8_t* dst, const uint8_t* src, const uint8_t* alpha,
+                              int32_t from, int32_t to);
+
+typedef struct {
+    pthread_t thread;
+    lv_mainwnd_blit_op_t op;
+    lv_mainwnd_blit_dsc_t band;
+    bool busy;
+} blit_worker_t;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    blit_worker_t workers[MAX_WORKERS];
+    uint32_t count;
+    uint32_t pending;
+    bool exiting;
+} blit_pool_t;
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+
+static blit_pool_t pool = {
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+        .start = PTHREAD_COND_INITIALIZER,
+        .done = PTHREAD_COND_INITIALIZER,
+};
+
+/**********************
+ *  STATIC FUNCTIONS
+ **********************/
+
+/*
+ * All kernels blend in 8 bit per channel and divide by 255 with rounding, the
+ * vector and scalar paths give the same result bit for bit.
+ */
+static inline uint8_t div255(uint32_t x) {
+    return (uint8_t)((x + 128 + ((x + 128) >> 8)) >> 8);
+}
+
+static inline uint8_t blend8(uint32_t f, uint32_t b, uint32_t a) {
+    return div255(f * a + b * (255 - a));
+}
+
+static inline void unpack_rgb565(uint16_t p, uint32_t* r, uint32_t* g, uint32_t* b) {
+    uint32_t r5 = p >> 11;
+    uint32_t g6 = (p >> 5) & 0x3F;
+    uint32_t b5 = p & 0x1F;
+    *r = (r5 << 3) | (r5 >> 2);
+    *g = (g6 << 2) | (g6 >> 4);
+    *b = (b5 << 3) | (b5 >> 2);
+}
+
+static inline uint16_t pack_rgb565(uint32_t r, uint32_t g, uint32_t b) {
+    return (uint16_t)(((r & 0xF8) << 8) | ((g & 0xFC) << 3) | (b >> 3));
+}
+
+static void argb8888_over_xrgb8888_row(uint8_t* dst, const uint8_t* src, const uint8_t* alpha,
+                                       int32_t from, int32_t to) {
+    (void)alpha;
+    for (int32_t x = from; x < to; x++) {
+        const uint8_t* s = src + x * 4;
+        uint8_t* d = dst + x * 4;
+        uint32_t a = s[3];
+        if (a == 0) continue;
+        if (a == 255) {
+            d[0] = s[0];
+            d[1] = s[1];
+            d[2] = s[2];
+            continue;
+        }
+        d[0] = blend8(s[0], d[0], a);
+        d[1] = blend8(s[1], d[1], a);
+        d[2] = blend8(s[2], d[2], a);
+    }
+}
+
+static void argb8888_over_rgb565_row(uint8_t* dst, const uint8_t* src, const uint8_t* alpha,
+                                     int32_t from, int32_t to) {
+    (void)alpha;
+    uint16_t* d = (uint16_t*)dst;
+    for (int32_t x = from; x < to; x++) {
+        const uint8_t* s = src + x * 4;
+        uint32_t a = s[3];
+        if (a == 0) continue;
+        if (a == 255) {
+            d[x] = pack_rgb565(s[2], s[1], s[0]);
+            continue;
+        }
+        uint32_t r, g, b;
+        unpack_rgb565(d[x], &r, &g, &b);
+        d[x] = pack_rgb565(blend8(s[2], r, a), blend8(s[1], g, a), blend8(s[0], b, a));
+    }
+}
+
+static void rgb565a8_over_rgb565_row(uint8_t* dst, const uint8_t* src, const uint8_t* alpha,
+                                     int32_t from, int32_t to) {
+    uint16_t* d = (uint16_t*)dst;
+    const uint16_t* s = (const uint16_t*)src;
+    for (int32_t x = from; x < to; x++) {
+        uint32_t a = alpha[x];
+        if (a == 0) continue;
+        if (a == 255) {
+            d[x] = s[x];
+            continue;
+        }
+        uint32_t fr, fg, fb, r, g, b;
+        unpack_rgb565(s[x], &fr, &fg, &fb);
+        unpack_rgb565(d[x], &r, &g, &b);
+        d[x] = pack_rgb565(blend8(fr, r, a), blend8(fg, g, a), blend8(fb, b, a));
+    }
+}
+
+static void rgb565_copy_row(uint8_t* dst, const uint8_t* src, const uint8_t* alpha, int32_t from,
+                            int32_t to) {
+    (void)alpha;
+    memcpy(dst + from * 2, src + from * 2, (to - from) * 2);
+}
+
+#ifdef BLIT_USE_NEON
+static inline uint8x8_t neon_blend8(uint8x8_t f, uint8x8_t b, uint8x8_t a, uint8x8_t ia) {
+    uint16x8_t x = vmlal_u8(vmull_u8(f, a), b, ia);
+    return vrshrn_n_u16(vrsraq_n_u16(x, x, 8), 8);
+}
+
+static inline void neon_unpack_rgb565(uint16x8_t p, uint8x8_t* r, uint8x8_t* g, uint8x8_t* b) {
+    uint8x8_t r8 = vand_u8(vshrn_n_u16(p, 8), vdup_n_u8(0xF8));
+    uint8x8_t g8 = vand_u8(vshrn_n_u16(p, 3), vdup_n_u8(0xFC));
+    uint8x8_t b8 = vshl_n_u8(vmovn_u16(p), 3);
+    *r = vorr_u8(r8, vshr_n_u8(r8, 5));
+    *g = vorr_u8(g8, vshr_n_u8(g8, 6));
+    *b = vorr_u8(b8, vshr_n_u8(b8, 5));
+}
+
+static inline uint16x8_t neon_pack_rgb565(uint8x8_t r, uint8x8_t g, uint8x8_t b) {
+    uint16x8_t p = vshll_n_u8(r, 8);
+    p = vsriq_n_u16(p, vshll_n_u8(g, 8), 5);
+    return vsriq_n_u16(p, vshll_n_u8(b, 8), 11);
+}
+
+static void neon_argb8888_over_xrgb8888_row(uint8_t* dst, const uint8_t* src,
+                                            const uint8_t* alpha, int32_t from, int32_t to) {
+    int32_t x = from;
+    for (; x + NEON_STEP <= to; x += NEON_STEP) {
+        uint8x8x4_t s = vld4_u8(src + x * 4);
+        uint8x8x4_t d = vld4_u8(dst + x * 4);
+        uint8x8_t ia = vmvn_u8(s.val[3]);
+        d.val[0] = neon_blend8(s.val[0], d.val[0], s.val[3], ia);
+        d.val[1] = neon_blend8(s.val[1], d.val[1], s.val[3], ia);
+        d.val[2] = neon_blend8(s.val[2], d.val[2], s.val[3], ia);
+        vst4_u8(dst + x * 4, d);
+    }
+    argb8888_over_xrgb8888_row(dst, src, alpha, x, to);
+}
+
+static void neon_argb8888_over_rgb565_row(uint8_t* dst, const uint8_t* src, const uint8_t* alpha,
+                                          int32_t from, int32_t to) {
+    uint16_t* d = (uint16_t*)dst;
+    int32_t x = from;
+    for (; x + NEON_STEP <= to; x += NEON_STEP) {
+        uint8x8x4_t s = vld4_u8(src + x * 4);
+        uint8x8_t ia = vmvn_u8(s.val[3]);
+        uint8x8_t r, g, b;
+        neon_unpack_rgb565(vld1q_u16(d + x), &r, &g, &b);
+        r = neon_blend8(s.val[2], r, s.val[3], ia);
+        g = neon_blend8(s.val[1], g, s.val[3], ia);
+        b = neon_blend8(s.val[0], b, s.val[3], ia);
+        vst1q_u16(d + x, neon_pack_rgb565(r, g, b));
+    }
+    argb8888_over_rgb565_row(dst, src, alpha, x, to);
+}
+
+static void neon_rgb565a8_over_rgb565_row(uint8_t* dst, const uint8_t* src, const uint8_t* alpha,
+                                          int32_t from, int32_t to) {
+    uint16_t* d = (uint16_t*)dst;
+    const uint16_t* s = (const uint16_t*)src;
+    int32_t x = from;
+    for (; x + NEON_STEP <= to; x += NEON_STEP) {
+        uint8x8_t a = vld1_u8(alpha + x);
+        uint8x8_t ia = vmvn_u8(a);
+        uint8x8_t fr, fg, fb, r, g, b;
+        neon_unpack_rgb565(vld1q_u16(s + x), &fr, &fg, &fb);
+        neon_unpack_rgb565(vld1q_u16(d + x), &r, &g, &b);
+        r = neon_blend8(fr, r, a, ia);
+        g = neon_blend8(fg, g, a, ia);
+        b = neon_blend8(fb, b, a, ia);
+        vst1q_u16(d + x, neon_pack_rgb565(r, g, b));
+    }
+    rgb565a8_over_rgb565_row(dst, src, alpha, x, to);
+}
+#endif
+
+static blit_row_cb_t scalar_row_cb(lv_mainwnd_blit_op_t op) {
+    switch (op) {
+        case LV_MAINWND_BLIT_ARGB8888_OVER_RGB565:
+            return argb8888_over_rgb565_row;
+        case LV_MAINWND_BLIT_ARGB8888_OVER_XRGB8888:
+            return argb8888_over_xrgb8888_row;
+        case LV_MAINWND_BLIT_RGB565_COPY:
+            return rgb565_copy_row;
+        case LV_MAINWND_BLIT_RGB565A8_OVER_RGB565:
+            return rgb565a8_over_rgb565_row;
+        default:
+            return NULL;
+    }
+}
+
+static blit_row_cb_t fast_row_cb(lv_mainwnd_blit_op_t op) {
+#ifdef BLIT_USE_NEON
+    switch (op) {
+        case LV_MAINWND_BLIT_ARGB8888_OVER_RGB565:
+            return neon_argb8888_over_rgb565_row;
+        case LV_MAINWND_BLIT_ARGB8888_OVER_XRGB8888:
+            return neon_argb8888_over_xrgb8888_row;
+        case LV_MAINWND_BLIT_RGB565A8_OVER_RGB565:
+            return neon_rgb565a8_over_rgb565_row;
+        default:
+            break;
+    }
+#endif
+    /* memcpy is already vectorized by libc */
+    return scalar_row_cb(op);
+}
+
+static void blit_rows(blit_row_cb_t row_cb, const lv_mainwnd_blit_dsc_t* dsc) {
+    if (!row_cb || !dsc || dsc->w <= 0 || dsc->h <= 0) return;
+
+    uint8_t* dst = dsc->dst;
+    const uint8_t* src = dsc->src;
+    const uint8_t* alpha = dsc->alpha;
+    for (int32_t y = 0; y < dsc->h; y++) {
+        row_cb(dst, src, alpha, 0, dsc->w);
+        dst += dsc->dst_stride;
+        src += dsc->src_stride;
+        if (alpha) alpha += dsc->alpha_stride;
+    }
+}
+
+/* rows [from, from + rows) of dsc */
+static void get_band(const lv_mainwnd_blit_dsc_t* dsc, int32_t from, int32_t rows,
+                     lv_mainwnd_blit_dsc_t* band) {
+    *band = *dsc;
+    band->dst += from * dsc->dst_stride;
+    band->src += from * dsc->src_stride;
+    if (dsc->alpha) band->alpha += from * dsc->alpha_stride;
+    band->h = rows;
+}
+
+static void* worker_main(void* arg) {
+    blit_worker_t* worker = (blit_worker_t*)arg;
+
+    pthread_mutex_lock(&pool.lock);
+    while (true) {
+        while (!worker->busy && !pool.exiting) pthread_cond_wait(&pool.start, &pool.lock);
+        if (pool.exiting) break;
+
+        /* bands are disjoint rows of the destination, window buffers are only read */
+        pthread_mutex_unlock(&pool.lock);
+        blit_rows(fast_row_cb(worker->op), &worker->band);
+        pthread_mutex_lock(&pool.lock);
+
+        worker->busy = false;
+        if (--pool.pending == 0) pthread_cond_signal(&pool.done);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return NULL;
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+
+uint32_t lv_mainwnd_blit_init(uint32_t workers) {
+    if (pool.count > 0) return pool.count;
+    if (workers > MAX_WORKERS) workers = MAX_WORKERS;
+
+    pool.exiting = false;
+    for (uint32_t i = 0; i < workers; i++) {
+        blit_worker_t* worker = &pool.workers[i];
+        worker->busy = false;
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) break;
+        pool.count++;
+    }
+    return pool.count;
+}
+
+void lv_mainwnd_blit_deinit(void) {
+    if (pool.count == 0) return;
+
+    pthread_mutex_lock(&pool.lock);
+    pool.exiting = true;
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+
+    for (uint32_t i = 0; i < pool.count; i++) {
+        pthread_join(pool.workers[i].thread, NULL);
+    }
+    pool.count = 0;
+}
+
+void lv_mainwnd_blit_parallel(lv_mainwnd_blit_op_t op, const lv_mainwnd_blit_dsc_t* dsc) {
+    if (!dsc || dsc->h <= 0) return;
+
+    /* a copy is bound by memory bandwidth, more cores do not help it */
+    uint32_t bands = op == LV_MAINWND_BLIT_RGB565_COPY ? 1 : dsc->h / MIN_BAND_ROWS;
+    if (bands > pool.count + 1) bands = pool.count + 1;
+    if (bands < 2) {
+        lv_mainwnd_blit(op, dsc);
+        return;
+    }
+
+    /* the caller takes the first band, the workers the others */
+    int32_t rows = (dsc->h + bands - 1) / bands;
+    pthread_mutex_lock(&pool.lock);
+    for (uint32_t i = 1; i < bands; i++) {
+        blit_worker_t* worker = &pool.workers[i - 1];
+        int32_t from = i * rows;
+        get_band(dsc, from, LV_MAINWND_BLIT_MIN(rows, dsc->h - from), &worker->band);
+        worker->op = op;
+        worker->busy = true;
+        pool.pending++;
+    }
+    pthread_cond_broadcast(&pool.start);
+    pthread_mutex_unlock(&pool.lock);
+
+    lv_mainwnd_blit_dsc_t band;
+    get_band(dsc, 0, rows, &band);
+    lv_mainwnd_blit(op, &band);
+
+    pthread_mutex_lock(&pool.lock);
+    while (pool.pending > 0) pthread_cond_wait(&pool.done, &pool.lock);
+    pthread_mutex_unlock(&pool.lock);
+}
+
+void lv_mainwnd_blit(lv_mainwnd_blit_op_t op, const lv_mainwnd_blit_dsc_t* dsc) {
+    blit_rows(fast_row_cb(op), dsc);
+}
+
+void lv_mainwnd_blit_scalar(lv_mainwnd_blit_op_t op, const lv_mainwnd_blit_dsc_t* dsc) {
+    blit_rows(scalar_row_cb(op), dsc);
+}
+
+const char* lv_mainwnd_blit_isa(void) {
+#ifdef BLIT_USE_NEON
+    return "neon";
+#else
+    return "scalar";
+#endif
+}
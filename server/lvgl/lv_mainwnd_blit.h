@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file lv_mainwnd_blit.h
+ *
+ */
+
+#ifndef LV_MAINWND_BLIT_H
+#define LV_MAINWND_BLIT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*********************
+ *      INCLUDES
+ *********************/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+
+/**
+ * window to framebuffer cases with a dedicated kernel*/
+typedef enum {
+    LV_MAINWND_BLIT_NONE = 0,
+    LV_MAINWND_BLIT_ARGB8888_OVER_RGB565,
+    LV_MAINWND_BLIT_ARGB8888_OVER_XRGB8888,
+    LV_MAINWND_BLIT_RGB565_COPY,
+    LV_MAINWND_BLIT_RGB565A8_OVER_RGB565,
+} lv_mainwnd_blit_op_t;
+
+/**
+ * one unscaled rectangle, strides are in bytes*/
+typedef struct {
+    uint8_t* dst;
+    int32_t dst_stride;
+    const uint8_t* src;
+    int32_t src_stride;
+    // alpha plane, only for RGB565A8
+    const uint8_t* alpha;
+    int32_t alpha_stride;
+    int32_t w;
+    int32_t h;
+} lv_mainwnd_blit_dsc_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+
+/**
+ * Blit a rectangle with the fastest kernel built for this target.
+ * @param op            blit case
+ * @param dsc           pointer to the rectangle descriptor
+ */
+void lv_mainwnd_blit(lv_mainwnd_blit_op_t op, const lv_mainwnd_blit_dsc_t* dsc);
+
+/**
+ * Blit a rectangle with the portable kernel, same result as lv_mainwnd_blit.
+ * @param op            blit case
+ * @param dsc           pointer to the rectangle descriptor
+ */
+void lv_mainwnd_blit_scalar(lv_mainwnd_blit_op_t op, const lv_mainwnd_blit_dsc_t* dsc);
+
+/**
+ * Start the helper threads of lv_mainwnd_blit_parallel.
+ * @param workers       number of helper threads, the caller works too
+ * @return the number of helper threads running
+ */
+uint32_t lv_mainwnd_blit_init(uint32_t workers);
+
+/**
+ * Stop the helper threads.
+ */
+void lv_mainwnd_blit_deinit(void);
+
+/**
+ * Blit a rectangle split in bands of rows over the helper threads, returns
+ * once every band is done. Same as lv_mainwnd_blit without helper threads.
+ * @param op            blit case
+ * @param dsc           pointer to the rectangle descriptor
+ */
+void lv_mainwnd_blit_parallel(lv_mainwnd_blit_op_t op, const lv_mainwnd_blit_dsc_t* dsc);
+
+/**
+ * Name of the instruction set lv_mainwnd_blit uses.
+ * @return "neon" or "scalar"
+ */
+const char* lv_mainwnd_blit_isa(void);
+
+/**********************
+ *      MACROS
+ **********************/
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+#endif /*LV_MAINWND_BLIT_H*/
@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+#include "../server/lvgl/lv_mainwnd_blit.h"
+
+namespace os {
+namespace wm {
+
+static constexpr int32_t WIDTH = 466;
+static constexpr int32_t HEIGHT = 466;
+
+typedef struct {
+    lv_mainwnd_blit_op_t op;
+    const char* name;
+    int32_t srcBpp;
+    int32_t dstBpp;
+    bool hasAlpha;
+} BlitCase;
+
+static const BlitCase kCases[] = {
+        {LV_MAINWND_BLIT_ARGB8888_OVER_RGB565, "ARGB8888 over RGB565", 4, 2, false},
+        {LV_MAINWND_BLIT_ARGB8888_OVER_XRGB8888, "ARGB8888 over XRGB8888", 4, 4, false},
+        {LV_MAINWND_BLIT_RGB565_COPY, "RGB565 copy", 2, 2, false},
+        {LV_MAINWND_BLIT_RGB565A8_OVER_RGB565, "RGB565A8 over RGB565", 2, 2, true},
+};
+
+static uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void fillRandom(std::vector<uint8_t>& buffer) {
+    for (auto& value : buffer) {
+        value = rand() & 0xFF;
+    }
+}
+
+/* mostly opaque or transparent pixels with soft edges, like real window content */
+static void fillAlpha(uint8_t* alpha, int32_t count, int32_t step) {
+    for (int32_t i = 0; i < count; i++) {
+        int32_t r = rand() % 8;
+        alpha[i * step] = r < 5 ? 0xFF : (r < 7 ? 0 : rand() & 0xFF);
+    }
+}
+
+enum { MODE_SCALAR, MODE_FAST, MODE_PARALLEL };
+
+static double runCase(const BlitCase& c, lv_mainwnd_blit_dsc_t& dsc, std::vector<uint8_t>& dst,
+                      const std::vector<uint8_t>& background, int frames, int mode) {
+    uint64_t elapsed = 0;
+    for (int i = 0; i < frames; i++) {
+        memcpy(dst.data(), background.data(), dst.size());
+        uint64_t start = nowNs();
+        if (mode == MODE_SCALAR) {
+            lv_mainwnd_blit_scalar(c.op, &dsc);
+        } else if (mode == MODE_FAST) {
+            lv_mainwnd_blit(c.op, &dsc);
+        } else {
+            lv_mainwnd_blit_parallel(c.op, &dsc);
+        }
+        elapsed += nowNs() - start;
+    }
+    return (double)WIDTH * HEIGHT * frames / ((double)elapsed / 1000.0);
+}
+
+extern "C" int main(int argc, char** argv) {
+    int frames = argc > 1 ? atoi(argv[1]) : 200;
+    if (frames <= 0) frames = 200;
+    uint32_t workers = lv_mainwnd_blit_init(argc > 2 ? atoi(argv[2]) : 0);
+
+    printf("%dx%d, %d frames, kernels: %s, workers: %" PRIu32 "\n", WIDTH, HEIGHT, frames,
+           lv_mainwnd_blit_isa(), workers);
+    for (const auto& c : kCases) {
+        int32_t srcStride = WIDTH * c.srcBpp;
+        int32_t dstStride = WIDTH * c.dstBpp;
+        std::vector<uint8_t> src(srcStride * HEIGHT + (c.hasAlpha ? WIDTH * HEIGHT : 0));
+        std::vector<uint8_t> background(dstStride * HEIGHT);
+        std::vector<uint8_t> dst(background.size());
+        std::vector<uint8_t> expected(background.size());
+        fillRandom(src);
+        fillRandom(background);
+        if (c.op == LV_MAINWND_BLIT_ARGB8888_OVER_RGB565 ||
+            c.op == LV_MAINWND_BLIT_ARGB8888_OVER_XRGB8888) {
+            fillAlpha(src.data() + 3, WIDTH * HEIGHT, 4);
+        } else if (c.hasAlpha) {
+            fillAlpha(src.data() + srcStride * HEIGHT, WIDTH * HEIGHT, 1);
+        }
+
+        lv_mainwnd_blit_dsc_t dsc;
+        dsc.src = src.data();
+        dsc.src_stride = srcStride;
+        dsc.alpha = c.hasAlpha ? src.data() + srcStride * HEIGHT : nullptr;
+        dsc.alpha_stride = WIDTH;
+        dsc.w = WIDTH;
+        dsc.h = HEIGHT;
+        dsc.dst_stride = dstStride;
+
+        /* the fast path must match the portable one bit for bit */
+        expected = background;
+        dsc.dst = expected.data();
+        lv_mainwnd_blit_scalar(c.op, &dsc);
+        dst = background;
+        dsc.dst = dst.data();
+        lv_mainwnd_blit(c.op, &dsc);
+        if (dst != expected) {
+            printf("%s: fast kernel differs from scalar\n", c.name);
+            lv_mainwnd_blit_deinit();
+            return -1;
+        }
+        dst = background;
+        lv_mainwnd_blit_parallel(c.op, &dsc);
+        if (dst != expected) {
+            printf("%s: parallel blit differs from scalar\n", c.name);
+            lv_mainwnd_blit_deinit();
+            return -1;
+        }
+
+        double scalar = runCase(c, dsc, dst, background, frames, MODE_SCALAR);
+        double fast = runCase(c, dsc, dst, background, frames, MODE_FAST);
+        printf("  %-24s scalar %8.1f MPix/s, fast %8.1f MPix/s (x%.2f)\n", c.name, scalar, fast,
+               fast / scalar);
+        if (workers > 0) {
+            double parallel = runCase(c, dsc, dst, background, frames, MODE_PARALLEL);
+            printf("  %-24s parallel %6.1f MPix/s (x%.2f)\n", "", parallel, parallel / scalar);
+        }
+    }
+    lv_mainwnd_blit_deinit();
+    return 0;
+}
+
+} // namespace wm
+} // namespace os
@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+#include "wm/BufferQueue.h"
+#include "wm/SurfaceControl.h"
+
+namespace os {
+namespace wm {
+
+/*
+ * The list based state machine used before the fixed slot table, kept here
+ * only as the reference for the comparison.
+ */
+class LegacyBufferQueue {
+public:
+    LegacyBufferQueue(const std::vector<BufferKey>& keys) {
+        for (auto key : keys) {
+            mBuffers[key] = {key, -1, nullptr, 0, BSTATE_FREE, nullptr};
+            mFreeSlot.push_back(key);
+        }
+    }
+
+    BufferItem* dequeueBuffer() {
+        BufferItem* item = getBuffer(BSLOT_FREE);
+        return item && toState(item, BSTATE_DEQUEUED) ? item : nullptr;
+    }
+
+    bool queueBuffer(BufferItem* item) {
+        return toState(item, BSTATE_QUEUED);
+    }
+
+    BufferItem* acquireBuffer() {
+        BufferItem* item = getBuffer(BSLOT_DATA);
+        return item && toState(item, BSTATE_ACQUIRED) ? item : nullptr;
+    }
+
+    bool releaseBuffer(BufferItem* item) {
+        return toState(item, BSTATE_FREE);
+    }
+
+    BufferItem* syncState(BufferKey key, BufferState byState) {
+        BufferItem* item = getBuffer(key);
+        if (!item) return nullptr;
+
+        if ((item->mState == BSTATE_QUEUED && byState == BSTATE_FREE) ||
+            (item->mState == BSTATE_FREE && byState == BSTATE_QUEUED)) {
+            if (toState(item, byState)) return item;
+        }
+        return nullptr;
+    }
+
+private:
+    BufferItem* getBuffer(BufferKey bufKey) {
+        if (mBuffers.find(bufKey) != mBuffers.end()) {
+            return &mBuffers[bufKey];
+        }
+        return nullptr;
+    }
+
+    BufferItem* getBuffer(BufferSlot slot) {
+        BufferKey key = -1;
+        if (slot == BSLOT_FREE && !mFreeSlot.empty()) {
+            key = mFreeSlot.front();
+        } else if (slot == BSLOT_DATA && !mDataSlot.empty()) {
+            key = mDataSlot.front();
+        }
+        return getBuffer(key);
+    }
+
+    bool inSlot(std::list<BufferKey>& slot, BufferKey key) {
+        return std::find(slot.begin(), slot.end(), key) != slot.end();
+    }
+
+    bool toState(BufferItem* item, BufferState state) {
+        switch (item->mState) {
+            case BSTATE_FREE:
+                if (!inSlot(mFreeSlot, item->mKey)) return false;
+                if (state == BSTATE_DEQUEUED) {
+                    mFreeSlot.remove(item->mKey);
+                } else if (state == BSTATE_QUEUED) {
+                    mFreeSlot.remove(item->mKey);
+                    mDataSlot.push_back(item->mKey);
+                } else {
+                    return false;
+                }
+                break;
+
+            case BSTATE_DEQUEUED:
+                if (state == BSTATE_QUEUED && !inSlot(mDataSlot, item->mKey)) {
+                    mDataSlot.push_back(item->mKey);
+                } else if (state == BSTATE_FREE && !inSlot(mFreeSlot, item->mKey)) {
+                    mFreeSlot.push_back(item->mKey);
+                } else {
+                    return false;
+                }
+                break;
+
+            case BSTATE_QUEUED:
+            case BSTATE_ACQUIRED:
+                if (state == BSTATE_ACQUIRED && item->mState == BSTATE_QUEUED) {
+                    break;
+                }
+                if (state != BSTATE_FREE || !inSlot(mDataSlot, item->mKey)) return false;
+                mDataSlot.remove(item->mKey);
+                mFreeSlot.push_back(item->mKey);
+                break;
+
+            default:
+                return false;
+        }
+        item->mState = state;
+        return true;
+    }
+
+    std::unordered_map<BufferKey, BufferItem> mBuffers;
+    std::list<BufferKey> mDataSlot;
+    std::list<BufferKey> mFreeSlot;
+};
+
+static uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* one frame: dequeue, queue, sync to consumer, acquire, sync to producer, release */
+template <typename P, typename C>
+static bool runFrame(P& producer, C& consumer) {
+    BufferItem* item = producer.dequeueBuffer();
+    if (!item || !producer.queueBuffer(item)) return false;
+
+    BufferKey key = item->mKey;
+    BufferItem* queued = consumer.syncState(key, BSTATE_QUEUED);
+    BufferItem* acquired = consumer.acquireBuffer();
+    if (!queued || acquired != queued) return false;
+
+    return producer.syncState(key, BSTATE_FREE) && consumer.releaseBuffer(acquired);
+}
+
+/* adapters exposing the protected sync entry like the legacy queue */
+class BenchProducer : public BufferProducer {
+public:
+    BenchProducer(const std::shared_ptr<SurfaceControl>& sc) : BufferProducer(sc) {}
+    BufferItem* syncState(BufferKey key, BufferState state) {
+        return BufferQueue::syncState(key, state);
+    }
+};
+
+class BenchConsumer : public BufferConsumer {
+public:
+    BenchConsumer(const std::shared_ptr<SurfaceControl>& sc) : BufferConsumer(sc) {}
+    BufferItem* syncState(BufferKey key, BufferState state) {
+        return BufferQueue::syncState(key, state);
+    }
+};
+
+static std::shared_ptr<SurfaceControl> createSurface(const std::vector<BufferKey>& keys) {
+    std::vector<BufferId> ids;
+    for (auto key : keys) {
+        std::string name = "bqbench" + std::to_string(key);
+        int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, S_IRUSR | S_IWUSR);
+        ftruncate(fd, 64);
+        shm_unlink(name.c_str());
+        ids.push_back({name, key, fd});
+    }
+
+    auto sc = std::make_shared<SurfaceControl>(nullptr, nullptr, 0, 0, 0, 64);
+    sc->initBufferIds(ids);
+    return sc;
+}
+
+static std::vector<BufferId> dupIds(const std::vector<BufferId>& ids) {
+    std::vector<BufferId> result;
+    for (const auto& id : ids) {
+        result.push_back({id.mName, id.mKey, dup(id.mFd)});
+    }
+    return result;
+}
+
+extern "C" int main(int argc, char** argv) {
+    int frames = argc > 1 ? atoi(argv[1]) : 100000;
+    if (frames <= 0) frames = 100000;
+
+    for (uint32_t count = 2; count <= 3; count++) {
+        std::vector<BufferKey> keys;
+        for (uint32_t i = 0; i < count; i++) {
+            keys.push_back(rand() % 999999999 + 1);
+        }
+
+        LegacyBufferQueue legacyProducer(keys);
+        LegacyBufferQueue legacyConsumer(keys);
+
+        auto producerSurface = createSurface(keys);
+        auto consumerSurface = std::make_shared<SurfaceControl>(nullptr, nullptr, 0, 0, 0, 64);
+        consumerSurface->initBufferIds(dupIds(producerSurface->bufferIds()));
+        BenchProducer producer(producerSurface);
+        BenchConsumer consumer(consumerSurface);
+
+        uint64_t start = nowNs();
+        for (int i = 0; i < frames; i++) {
+            if (!runFrame(legacyProducer, legacyConsumer)) {
+                printf("legacy state machine failed at frame %d\n", i);
+                return -1;
+            }
+        }
+        uint64_t legacyNs = nowNs() - start;
+
+        start = nowNs();
+        for (int i = 0; i < frames; i++) {
+            if (!runFrame(producer, consumer)) {
+                printf("slot table state machine failed at frame %d\n", i);
+                return -1;
+            }
+        }
+        uint64_t slotNs = nowNs() - start;
+
+        printf("%" PRIu32 " buffers, %d frames:\n", count, frames);
+        printf("  list + unordered_map : %8.1f ns/frame\n", (double)legacyNs / frames);
+        printf("  fixed slot table     : %8.1f ns/frame\n", (double)slotNs / frames);
+    }
+    return 0;
+}
+
+} // namespace wm
+} // namespace os
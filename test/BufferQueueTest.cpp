@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <binder/Binder.h>
 #include <gtest/gtest.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -96,6 +97,179 @@ TEST_F(BufferQueueTest, AcquiredReleaseBuffer) {
     EXPECT_EQ(buffConsumer->releaseBuffer(buffer2), true);
 }
 
+TEST_F(BufferQueueTest, ReleaseOutOfOrder) {
+    std::shared_ptr<BufferConsumer> buffConsumer = std::make_shared<BufferConsumer>(mSCConsumer);
+    BufferItem* buffer1 = buffConsumer->syncQueuedState(1);
+    BufferItem* buffer2 = buffConsumer->syncQueuedState(2);
+    EXPECT_NE(buffer1, nullptr);
+    EXPECT_NE(buffer2, nullptr);
+
+    // the newer buffer goes back first, the older one stays at the head of data slot
+    EXPECT_EQ(buffConsumer->releaseBuffer(buffer2), true);
+    EXPECT_EQ(buffConsumer->acquireBuffer(), buffer1);
+    EXPECT_EQ(buffConsumer->releaseBuffer(buffer1), true);
+    EXPECT_EQ(buffConsumer->acquireBuffer(), nullptr);
+    EXPECT_EQ(buffConsumer->releaseBuffer(buffer1), false);
+}
+
+TEST_F(BufferQueueTest, BufferAge) {
+    std::shared_ptr<BufferProducer> buffProducer = std::make_shared<BufferProducer>(mSCProducer);
+    BufferItem* buffer1 = buffProducer->dequeueBuffer();
+    EXPECT_EQ(buffer1->mAge, 0);
+    Rect damage1(0, 0, 9, 9);
+    EXPECT_EQ(buffProducer->queueBuffer(buffer1, &damage1), true);
+    EXPECT_EQ(buffer1->mAge, 1);
+
+    BufferItem* buffer2 = buffProducer->dequeueBuffer();
+    EXPECT_EQ(buffer2->mAge, 0);
+    Rect damage2(20, 20, 29, 29);
+    EXPECT_EQ(buffProducer->queueBuffer(buffer2, &damage2), true);
+    EXPECT_EQ(buffer2->mAge, 1);
+    EXPECT_EQ(buffer1->mAge, 2);
+    EXPECT_EQ(buffer1->mDamage.left, 20);
+    EXPECT_EQ(buffer1->mDamage.bottom, 29);
+
+    // buffer1 is reused, it only misses the damage of buffer2
+    EXPECT_NE(buffProducer->syncFreeState(buffer1->mKey), nullptr);
+    EXPECT_EQ(buffProducer->dequeueBuffer(), buffer1);
+    Rect damage3(5, 5, 14, 14);
+    EXPECT_EQ(buffProducer->queueBuffer(buffer1, &damage3), true);
+    EXPECT_EQ(buffer1->mAge, 1);
+    EXPECT_EQ(buffer2->mAge, 2);
+    EXPECT_EQ(buffer2->mDamage.left, 5);
+    EXPECT_EQ(buffer2->mDamage.right, 14);
+
+    // a frame without damage makes the other contents undefined
+    EXPECT_NE(buffProducer->syncFreeState(buffer2->mKey), nullptr);
+    EXPECT_EQ(buffProducer->dequeueBuffer(), buffer2);
+    EXPECT_EQ(buffProducer->queueBuffer(buffer2), true);
+    EXPECT_EQ(buffer1->mAge, 0);
+}
+
+TEST_F(BufferQueueTest, SharedBufferState) {
+    sp<IBinder> token = sp<android::BBinder>::make();
+    sp<IBinder> handle = sp<android::BBinder>::make();
+    std::string name = "testBufferState" + std::to_string(std::rand());
+
+    auto consumerSC = std::make_shared<SurfaceControl>(token, handle, 0, 0, 0, 20);
+    consumerSC->initBufferIds(mIdsConsumer);
+    consumerSC->getBufferState()->setName(name);
+    EXPECT_TRUE(consumerSC->initBufferState(true));
+
+    std::vector<BufferId> ids;
+    for (const auto& id : mIdsProducer) {
+        ids.push_back({id.mName, id.mKey, dup(id.mFd)});
+    }
+    auto producerSC = std::make_shared<SurfaceControl>(token, handle, 0, 0, 0, 20);
+    producerSC->initBufferIds(ids);
+    producerSC->getBufferState()->setName(name);
+    EXPECT_TRUE(producerSC->initBufferState(false));
+
+    auto buffConsumer = std::make_shared<BufferConsumer>(consumerSC);
+    auto buffProducer = std::make_shared<BufferProducer>(producerSC);
+    EXPECT_TRUE(buffConsumer->hasSharedState());
+    EXPECT_TRUE(buffProducer->hasSharedState());
+
+    // consumer can't take a buffer the producer hasn't queued
+    EXPECT_EQ(buffConsumer->syncQueuedState(1), nullptr);
+
+    BufferItem* buffer1 = buffProducer->dequeueBuffer();
+    BufferItem* buffer2 = buffProducer->dequeueBuffer();
+    EXPECT_NE(buffer1, nullptr);
+    EXPECT_NE(buffer2, nullptr);
+    EXPECT_EQ(buffProducer->dequeueBuffer(), nullptr);
+    EXPECT_TRUE(buffProducer->queueBuffer(buffer1));
+
+    BufferItem* queued = buffConsumer->syncQueuedState(buffer1->mKey);
+    EXPECT_NE(queued, nullptr);
+    EXPECT_EQ(buffConsumer->acquireBuffer(), queued);
+    EXPECT_TRUE(buffConsumer->releaseBuffer(queued));
+
+    // released without any message to the producer
+    EXPECT_EQ(buffProducer->dequeueBuffer(), buffer1);
+
+    consumerSC->destroyBufferState();
+    producerSC->destroyBufferState();
+}
+
+TEST_F(BufferQueueTest, PendingReleasesSharedState) {
+    sp<IBinder> token = sp<android::BBinder>::make();
+    sp<IBinder> handle = sp<android::BBinder>::make();
+    std::string name = "testBufferState" + std::to_string(std::rand());
+
+    auto consumerSC = std::make_shared<SurfaceControl>(token, handle, 0, 0, 0, 20);
+    consumerSC->initBufferIds(mIdsConsumer);
+    consumerSC->getBufferState()->setName(name);
+    EXPECT_TRUE(consumerSC->initBufferState(true));
+
+    std::vector<BufferId> ids;
+    for (const auto& id : mIdsProducer) {
+        ids.push_back({id.mName, id.mKey, dup(id.mFd)});
+    }
+    auto producerSC = std::make_shared<SurfaceControl>(token, handle, 0, 0, 0, 20);
+    producerSC->initBufferIds(ids);
+    producerSC->getBufferState()->setName(name);
+    EXPECT_TRUE(producerSC->initBufferState(false));
+
+    auto buffConsumer = std::make_shared<BufferConsumer>(consumerSC);
+    auto buffProducer = std::make_shared<BufferProducer>(producerSC);
+
+    BufferItem* buffer1 = buffProducer->dequeueBuffer();
+    BufferItem* buffer2 = buffProducer->dequeueBuffer();
+    EXPECT_TRUE(buffProducer->queueBuffer(buffer1));
+    EXPECT_TRUE(buffProducer->queueBuffer(buffer2));
+    EXPECT_EQ(buffProducer->dequeueBuffer(), nullptr);
+    EXPECT_EQ(buffProducer->pendingReleases(), 0u);
+
+    // released after the producer's last sync
+    BufferItem* queued = buffConsumer->syncQueuedState(buffer1->mKey);
+    EXPECT_EQ(buffConsumer->acquireBuffer(), queued);
+    EXPECT_TRUE(buffConsumer->releaseBuffer(queued));
+    EXPECT_EQ(buffProducer->pendingReleases(), 1u);
+
+    EXPECT_EQ(buffProducer->dequeueBuffer(), buffer1);
+    EXPECT_EQ(buffProducer->pendingReleases(), 0u);
+
+    consumerSC->destroyBufferState();
+    producerSC->destroyBufferState();
+}
+
+TEST_F(BufferQueueTest, PendingReleasesFmq) {
+    sp<IBinder> token = sp<android::BBinder>::make();
+    sp<IBinder> handle = sp<android::BBinder>::make();
+    std::string name = "/testReleaseFmq" + std::to_string(std::rand());
+
+    auto consumerSC = std::make_shared<SurfaceControl>(token, handle, 0, 0, 0, 20);
+    consumerSC->initBufferIds(mIdsConsumer);
+    consumerSC->getFMQ().setName(name);
+    EXPECT_TRUE(consumerSC->initFMQ(true));
+
+    auto producerSC = std::make_shared<SurfaceControl>(token, handle, 0, 0, 0, 20);
+    producerSC->initBufferIds(mIdsProducer);
+    producerSC->getFMQ().setName(name);
+    EXPECT_TRUE(producerSC->initFMQ(false));
+
+    auto buffProducer = std::make_shared<BufferProducer>(producerSC);
+
+    // the initial keys are drained before the first frame
+    BufferKey keys[BUFFER_QUEUE_MAX_SLOTS];
+    EXPECT_EQ(producerSC->getFMQ().readAll(keys, BUFFER_QUEUE_MAX_SLOTS), 2u);
+    EXPECT_EQ(buffProducer->pendingReleases(), 0u);
+
+    BufferItem* buffer1 = buffProducer->dequeueBuffer();
+    EXPECT_TRUE(buffProducer->queueBuffer(buffer1));
+
+    // a release message that arrived after the drain
+    EXPECT_TRUE(consumerSC->getFMQ().write(&buffer1->mKey));
+    EXPECT_EQ(buffProducer->pendingReleases(), 1u);
+
+    EXPECT_EQ(producerSC->getFMQ().readAll(keys, BUFFER_QUEUE_MAX_SLOTS), 1u);
+    EXPECT_EQ(buffProducer->pendingReleases(), 0u);
+
+    producerSC->destroyFMQ();
+    consumerSC->destroyFMQ();
+}
+
 extern "C" int main(int argc, char** argv) {
     testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "../server/DirtyTileMap.h"
+
+namespace os {
+namespace wm {
+
+static constexpr int32_t TILE = 32;
+static constexpr int32_t WIDTH = 466;
+static constexpr int32_t HEIGHT = 466;
+static constexpr uint32_t MAX_AREAS = 32;
+
+class DirtyTileMapTest : public ::testing::Test {
+protected:
+    DirtyTileMapTest() : map(TILE) {
+        map.resize(WIDTH, HEIGHT);
+    }
+
+    uint32_t collect() {
+        return map.collect(areas, MAX_AREAS);
+    }
+
+    DirtyTileMap map;
+    TileArea areas[MAX_AREAS];
+};
+
+static void expectArea(const TileArea& area, int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+    EXPECT_EQ(area.x1, x1);
+    EXPECT_EQ(area.y1, y1);
+    EXPECT_EQ(area.x2, x2);
+    EXPECT_EQ(area.y2, y2);
+}
+
+TEST_F(DirtyTileMapTest, MarkRoundsToTiles) {
+    EXPECT_TRUE(map.empty());
+    map.mark({40, 10, 70, 20});
+    EXPECT_EQ(map.dirtyCount(), 2u);
+
+    ASSERT_EQ(collect(), 1u);
+    expectArea(areas[0], 32, 0, 95, 31);
+}
+
+TEST_F(DirtyTileMapTest, ClipToDisplay) {
+    map.mark({-20, 450, 500, 600});
+    ASSERT_EQ(collect(), 1u);
+    expectArea(areas[0], 0, 448, WIDTH - 1, HEIGHT - 1);
+
+    map.clear();
+    map.mark({500, 500, 600, 600});
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ(collect(), 0u);
+}
+
+TEST_F(DirtyTileMapTest, FarApartStaySeparate) {
+    /* one bounding box would cover most of the screen */
+    map.mark({0, 0, 20, 20});
+    map.mark({440, 440, 465, 465});
+    ASSERT_EQ(collect(), 2u);
+    expectArea(areas[0], 0, 0, 31, 31);
+    expectArea(areas[1], 416, 416, WIDTH - 1, HEIGHT - 1);
+}
+
+TEST_F(DirtyTileMapTest, OverlapsMergeIntoRuns) {
+    map.mark({0, 0, 63, 63});
+    map.mark({32, 32, 95, 95});
+    EXPECT_EQ(map.dirtyCount(), 7u);
+
+    ASSERT_EQ(collect(), 3u);
+    expectArea(areas[0], 0, 0, 63, 31);
+    expectArea(areas[1], 0, 32, 95, 63);
+    expectArea(areas[2], 32, 64, 95, 95);
+}
+
+TEST_F(DirtyTileMapTest, TooScattered) {
+    /* a checkerboard needs one rectangle per tile */
+    for (int32_t y = 0; y < HEIGHT; y += 2 * TILE) {
+        for (int32_t x = 0; x < WIDTH; x += 2 * TILE) {
+            map.mark({x, y, x, y});
+        }
+    }
+    EXPECT_EQ(collect(), 0u);
+}
+
+extern "C" int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+} // namespace wm
+} // namespace os
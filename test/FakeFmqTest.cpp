@@ -14,7 +14,10 @@
  * limitations under the License.
  */
 
+#include <fcntl.h>
 #include <gtest/gtest.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include "wm/FakeFmq.h"
 
@@ -77,6 +80,75 @@ TEST_F(FakeFmqTest, TestServerWriteClientRead) {
     ASSERT_EQ(result, mExpectedTwo);
 }
 
+TEST_F(FakeFmqTest, TestZeroValue) {
+    int result = -1;
+    int zero = 0;
+
+    ASSERT_TRUE(mClientFmq.read(&result));
+    ASSERT_TRUE(mClientFmq.read(&result));
+
+    ASSERT_TRUE(mServerFmq.write(&zero));
+    ASSERT_EQ(mClientFmq.size(), 1u);
+    ASSERT_TRUE(mClientFmq.read(&result));
+    ASSERT_EQ(result, 0);
+    ASSERT_FALSE(mClientFmq.read(&result));
+}
+
+TEST_F(FakeFmqTest, TestFullAndWrap) {
+    int result = 0;
+    uint32_t caps = mServerFmq.capacity();
+    ASSERT_EQ(mServerFmq.size(), mData.size());
+
+    for (uint32_t i = mData.size(); i < caps; i++) {
+        ASSERT_TRUE(mServerFmq.write(&mExpectedOne));
+    }
+    ASSERT_FALSE(mServerFmq.write(&mExpectedTwo));
+
+    /* the writer gets room back once the reader moves on */
+    ASSERT_TRUE(mClientFmq.read(&result));
+    ASSERT_EQ(result, mExpectedOne);
+    ASSERT_TRUE(mServerFmq.write(&mExpectedTwo));
+    ASSERT_FALSE(mServerFmq.write(&mExpectedTwo));
+
+    /* the ring is full again, the last item is the one written after wrapping */
+    for (uint32_t i = 0; i < caps; i++) {
+        ASSERT_TRUE(mClientFmq.read(&result));
+    }
+    ASSERT_EQ(result, mExpectedTwo);
+    ASSERT_FALSE(mClientFmq.read(&result));
+}
+
+TEST_F(FakeFmqTest, TestReadAll) {
+    int results[4] = {0};
+
+    ASSERT_EQ(mClientFmq.readAll(results, 1), 1u);
+    ASSERT_EQ(results[0], mExpectedOne);
+
+    ASSERT_TRUE(mServerFmq.write(&mExpectedOne));
+    ASSERT_EQ(mClientFmq.readAll(results, 4), 2u);
+    ASSERT_EQ(results[0], mExpectedTwo);
+    ASSERT_EQ(results[1], mExpectedOne);
+    ASSERT_EQ(mClientFmq.readAll(results, 4), 0u);
+}
+
+TEST_F(FakeFmqTest, TestCorruptTail) {
+    int results[4] = {0};
+
+    /* a broken peer moves the tail far past the head */
+    int fd = shm_open(mServerFmq.getName().c_str(), O_RDWR, 0);
+    ASSERT_GE(fd, 0);
+    void* buffer = mmap(nullptr, sizeof(FmqHeader), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    ASSERT_NE(buffer, MAP_FAILED);
+    FmqHeader* header = (FmqHeader*)buffer;
+    header->mTail.store(header->mHead.load() + 0x80000000u);
+
+    ASSERT_EQ(mClientFmq.size(), 0u);
+    ASSERT_FALSE(mClientFmq.read(&results[0]));
+    ASSERT_EQ(mClientFmq.readAll(results, 4), 0u);
+    munmap(buffer, sizeof(FmqHeader));
+}
+
 extern "C" int main(int argc, char** argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "wm/LayerState.h"
+
+namespace os {
+namespace wm {
+
+static LayerState bufferState(BufferKey key, uint32_t seq) {
+    LayerState state;
+    state.mFlags = LayerState::LAYER_BUFFER_CHANGED;
+    state.mBufferKey = key;
+    state.mSeq = seq;
+    return state;
+}
+
+static LayerState bufferState(BufferKey key, uint32_t seq, const Rect* damage, uint32_t count) {
+    LayerState state = bufferState(key, seq);
+    state.setDamage(damage, count);
+    return state;
+}
+
+static void expectRect(const Rect& rect, int32_t l, int32_t t, int32_t r, int32_t b) {
+    EXPECT_EQ(rect.left, l);
+    EXPECT_EQ(rect.top, t);
+    EXPECT_EQ(rect.right, r);
+    EXPECT_EQ(rect.bottom, b);
+}
+
+TEST(LayerStateTest, TokenConstructorSeq) {
+    LayerState state(nullptr);
+    EXPECT_EQ(state.mSeq, 0u);
+    EXPECT_EQ(state.mFlags, 0);
+}
+
+TEST(LayerStateTest, SeqFollowsBuffer) {
+    LayerState pending = bufferState(1, 5);
+
+    LayerState position(nullptr);
+    position.mFlags = LayerState::LAYER_POSITION_CHANGED;
+    position.mX = 10;
+    position.mY = 20;
+    position.mSeq = 9;
+    pending.merge(position);
+    EXPECT_EQ(pending.mSeq, 5u);
+    EXPECT_EQ(pending.mBufferKey, 1);
+    EXPECT_EQ(pending.mX, 10);
+
+    LayerState alpha(nullptr);
+    alpha.mFlags = LayerState::LAYER_ALPHA_CHANGED;
+    alpha.mAlpha = 128;
+    pending.merge(alpha);
+    EXPECT_EQ(pending.mSeq, 5u);
+
+    LayerState next = bufferState(2, 12);
+    pending.merge(next);
+    EXPECT_EQ(pending.mSeq, 12u);
+    EXPECT_EQ(pending.mBufferKey, 2);
+    EXPECT_EQ(pending.mFlags,
+              LayerState::LAYER_POSITION_CHANGED | LayerState::LAYER_ALPHA_CHANGED |
+                      LayerState::LAYER_BUFFER_CHANGED);
+}
+
+TEST(LayerStateTest, FirstBufferTakesDamage) {
+    LayerState pending(nullptr);
+    pending.mFlags = LayerState::LAYER_POSITION_CHANGED;
+
+    Rect damage[] = {{0, 0, 10, 10}, {20, 20, 30, 30}};
+    LayerState state = bufferState(1, 3, damage, 2);
+    pending.merge(state);
+
+    EXPECT_TRUE(pending.mFlags & LayerState::LAYER_BUFFER_CROP_CHANGED);
+    expectRect(pending.mBufferCrop, 0, 0, 30, 30);
+    ASSERT_EQ(pending.mDamageCount, 2u);
+    expectRect(pending.mDamage[1], 20, 20, 30, 30);
+    EXPECT_EQ(pending.mSeq, 3u);
+}
+
+TEST(LayerStateTest, SupersededBufferUnionsDamage) {
+    Rect first[] = {{0, 0, 10, 10}};
+    Rect second[] = {{20, 20, 30, 30}, {40, 0, 50, 5}};
+    LayerState pending = bufferState(1, 1, first, 1);
+    LayerState state = bufferState(2, 2, second, 2);
+    pending.merge(state);
+
+    EXPECT_EQ(pending.mBufferKey, 2);
+    EXPECT_TRUE(pending.mFlags & LayerState::LAYER_BUFFER_CROP_CHANGED);
+    expectRect(pending.mBufferCrop, 0, 0, 50, 30);
+    ASSERT_EQ(pending.mDamageCount, 3u);
+    expectRect(pending.mDamage[0], 0, 0, 10, 10);
+    expectRect(pending.mDamage[2], 40, 0, 50, 5);
+}
+
+TEST(LayerStateTest, SupersededBufferDamageOverflow) {
+    Rect first[] = {{0, 0, 1, 1}, {2, 2, 3, 3}, {4, 4, 5, 5}};
+    Rect second[] = {{6, 6, 7, 7}, {8, 8, 9, 9}};
+    LayerState pending = bufferState(1, 1, first, 3);
+    LayerState state = bufferState(2, 2, second, 2);
+    pending.merge(state);
+
+    /* too many rects, only the bounds are kept */
+    ASSERT_EQ(pending.mDamageCount, 1u);
+    expectRect(pending.mDamage[0], 0, 0, 9, 9);
+    expectRect(pending.mBufferCrop, 0, 0, 9, 9);
+}
+
+TEST(LayerStateTest, SupersededBufferFullRedraw) {
+    Rect damage[] = {{0, 0, 10, 10}};
+
+    /* the newer buffer has no damage, the whole buffer is redrawn */
+    LayerState pending = bufferState(1, 1, damage, 1);
+    LayerState full = bufferState(2, 2);
+    pending.merge(full);
+    EXPECT_FALSE(pending.mFlags & LayerState::LAYER_BUFFER_CROP_CHANGED);
+    EXPECT_EQ(pending.mBufferKey, 2);
+
+    /* the skipped buffer had no damage, a newer crop can't narrow it */
+    LayerState state = bufferState(3, 3, damage, 1);
+    pending.merge(state);
+    EXPECT_FALSE(pending.mFlags & LayerState::LAYER_BUFFER_CROP_CHANGED);
+    EXPECT_EQ(pending.mBufferKey, 3);
+    EXPECT_EQ(pending.mSeq, 3u);
+}
+
+extern "C" int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+} // namespace wm
+} // namespace os
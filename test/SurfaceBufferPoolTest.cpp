@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../server/SurfaceBufferPool.h"
+
+namespace os {
+namespace wm {
+
+static constexpr uint32_t BUFFER_SIZE = 4096;
+static constexpr uint32_t FORMAT = 1;
+static constexpr int32_t PID_A = 100;
+static constexpr int32_t PID_B = 200;
+
+class SurfaceBufferPoolTest : public ::testing::Test {
+protected:
+    void TearDown() override {
+        for (const auto& name : names) {
+            shm_unlink(name.c_str());
+        }
+    }
+
+    /* buffers of one surface, the descriptors are closed like the surface does */
+    void recycle(SurfaceBufferPool& pool, int32_t pid, uint32_t count) {
+        std::vector<BufferId> ids;
+        for (uint32_t i = 0; i < count; i++) {
+            std::string name = "/wms-pool-test-" + std::to_string(names.size());
+            int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+            ASSERT_GE(fd, 0);
+            ASSERT_EQ(ftruncate(fd, BUFFER_SIZE), 0);
+            names.push_back(name);
+            ids.push_back({name, (BufferKey)names.size(), fd});
+        }
+
+        pool.recycle(pid, BUFFER_SIZE, FORMAT, ids);
+        for (const auto& id : ids) {
+            close(id.mFd);
+        }
+    }
+
+    static bool linked(const std::string& name) {
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0) return false;
+        close(fd);
+        return true;
+    }
+
+    std::vector<std::string> names;
+};
+
+TEST_F(SurfaceBufferPoolTest, ObtainWholeSurface) {
+    SurfaceBufferPool pool(2);
+    recycle(pool, PID_A, 3);
+    EXPECT_EQ(pool.size(), 1u);
+
+    std::vector<BufferId> ids;
+    EXPECT_FALSE(pool.obtain(PID_A, BUFFER_SIZE, FORMAT, 2, ids));
+    EXPECT_FALSE(pool.obtain(PID_A, BUFFER_SIZE * 2, FORMAT, 3, ids));
+    EXPECT_FALSE(pool.obtain(PID_A, BUFFER_SIZE, FORMAT + 1, 3, ids));
+
+    ASSERT_TRUE(pool.obtain(PID_A, BUFFER_SIZE, FORMAT, 3, ids));
+    ASSERT_EQ(ids.size(), 3u);
+    for (uint32_t i = 0; i < ids.size(); i++) {
+        EXPECT_EQ(ids[i].mName, names[i]);
+        EXPECT_GT(ids[i].mFd, 0);
+        EXPECT_TRUE(linked(ids[i].mName));
+        close(ids[i].mFd);
+    }
+    EXPECT_EQ(pool.size(), 0u);
+}
+
+TEST_F(SurfaceBufferPoolTest, ObtainSamePidOnly) {
+    SurfaceBufferPool pool(2);
+    recycle(pool, PID_A, 2);
+
+    std::vector<BufferId> ids;
+    EXPECT_FALSE(pool.obtain(PID_B, BUFFER_SIZE, FORMAT, 2, ids));
+    EXPECT_TRUE(ids.empty());
+    EXPECT_EQ(pool.size(), 1u);
+}
+
+TEST_F(SurfaceBufferPoolTest, EvictOldestSurface) {
+    SurfaceBufferPool pool(2);
+    recycle(pool, PID_A, 2);
+    recycle(pool, PID_A, 2);
+    recycle(pool, PID_B, 2);
+    EXPECT_EQ(pool.size(), 2u);
+
+    EXPECT_FALSE(linked(names[0]));
+    EXPECT_FALSE(linked(names[1]));
+    for (uint32_t i = 2; i < names.size(); i++) {
+        EXPECT_TRUE(linked(names[i]));
+    }
+
+    std::vector<BufferId> ids;
+    ASSERT_TRUE(pool.obtain(PID_A, BUFFER_SIZE, FORMAT, 2, ids));
+    EXPECT_EQ(ids[0].mName, names[2]);
+    for (const auto& id : ids) {
+        close(id.mFd);
+    }
+}
+
+TEST_F(SurfaceBufferPoolTest, ReleasePid) {
+    SurfaceBufferPool pool(4);
+    recycle(pool, PID_A, 2);
+    recycle(pool, PID_B, 2);
+    recycle(pool, PID_A, 2);
+
+    pool.release(PID_A);
+    EXPECT_EQ(pool.size(), 1u);
+    EXPECT_FALSE(linked(names[0]));
+    EXPECT_TRUE(linked(names[2]));
+    EXPECT_FALSE(linked(names[4]));
+
+    pool.clear();
+    EXPECT_EQ(pool.size(), 0u);
+    EXPECT_FALSE(linked(names[2]));
+}
+
+TEST_F(SurfaceBufferPoolTest, ZeroCapacity) {
+    SurfaceBufferPool pool(0);
+    recycle(pool, PID_A, 2);
+    EXPECT_EQ(pool.size(), 0u);
+
+    /* the pool owns recycled names, it unlinks what it cannot keep */
+    EXPECT_FALSE(linked(names[0]));
+    EXPECT_FALSE(linked(names[1]));
+}
+
+extern "C" int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+} // namespace wm
+} // namespace os
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2024 Xiaomi Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+
+#include "../server/VsyncModel.h"
+
+namespace os {
+namespace wm {
+
+static constexpr uint64_t PERIOD = 16667;
+static constexpr uint64_t THRESHOLD = 1000;
+static constexpr uint64_t RESYNC = 1000000;
+static constexpr uint64_t START = 5000000;
+
+class VsyncModelTest : public ::testing::Test {
+protected:
+    VsyncModelTest() : model(16000, THRESHOLD, RESYNC) {}
+
+    /* feeds vsyncs until the model locks, returns the time of the last one */
+    uint64_t lock(uint64_t start, uint64_t period) {
+        uint64_t time = start;
+        while (model.addVsyncSample(time)) {
+            time += period;
+            if (time - start > 100 * period) break;
+        }
+        return time;
+    }
+
+    VsyncModel model;
+};
+
+TEST_F(VsyncModelTest, LockToPeriod) {
+    EXPECT_FALSE(model.isLocked());
+    EXPECT_TRUE(model.addVsyncSample(START));
+
+    uint64_t last = lock(START, PERIOD);
+    EXPECT_TRUE(model.isLocked());
+    EXPECT_NEAR((double)model.getPeriod(), (double)PERIOD, 2.0);
+    EXPECT_NEAR((double)model.computeNextVsync(last + 1), (double)(last + PERIOD), 10.0);
+    EXPECT_NEAR((double)model.computeNextVsync(last + 10 * PERIOD + 1),
+                (double)(last + 11 * PERIOD), 20.0);
+}
+
+TEST_F(VsyncModelTest, MissedVsync) {
+    uint64_t time = START;
+    for (int i = 0; i < 6; i++) {
+        model.addVsyncSample(time);
+        /* every other vsync lost */
+        time += (i % 2) ? PERIOD : 2 * PERIOD;
+    }
+    EXPECT_TRUE(model.isLocked());
+    EXPECT_NEAR((double)model.getPeriod(), (double)PERIOD, 2.0);
+}
+
+TEST_F(VsyncModelTest, VerifyAndResync) {
+    uint64_t last = lock(START, PERIOD);
+    ASSERT_TRUE(model.isLocked());
+
+    EXPECT_FALSE(model.needsResync(last + PERIOD));
+    EXPECT_TRUE(model.needsResync(last + RESYNC));
+
+    /* a sample close to the prediction keeps the lock */
+    uint64_t verify = last + 60 * PERIOD + THRESHOLD / 2;
+    EXPECT_FALSE(model.addVsyncSample(verify));
+    EXPECT_TRUE(model.isLocked());
+    EXPECT_FALSE(model.needsResync(verify + PERIOD));
+
+    /* the panel moved its phase, the model relearns */
+    uint64_t shifted = verify + 60 * PERIOD + PERIOD / 2;
+    EXPECT_TRUE(model.addVsyncSample(shifted));
+    EXPECT_FALSE(model.isLocked());
+
+    lock(shifted + PERIOD, PERIOD);
+    EXPECT_TRUE(model.isLocked());
+}
+
+TEST_F(VsyncModelTest, JitterKeepsLearning) {
+    uint64_t time = START;
+    for (int i = 0; i < 8; i++) {
+        EXPECT_TRUE(model.addVsyncSample(time));
+        time += (i % 2) ? PERIOD + 3 * THRESHOLD : PERIOD - 3 * THRESHOLD;
+    }
+    EXPECT_FALSE(model.isLocked());
+}
+
+extern "C" int main(int argc, char** argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+} // namespace wm
+} // namespace os